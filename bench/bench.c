@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../includes/vm.h"
+#include "../includes/memory.h"
+
+// Benchmark driver, every workload is compiled and evaluated on a fresh instance per iteration,
+// lex, parse and eval are measured separately and written as JSON for diffing against a baseline
+//   _bench [-n iterations] [-o results.json] [--baseline baseline.json] scripts...
+
+#define BENCH_ITERATIONS 20
+//statements of the generated long source workload
+#define LONG_SOURCE_LINES 20000
+
+typedef enum { PHASE_LEX, PHASE_PARSE, PHASE_EVAL, PHASE_COUNT } Phase;
+static const char *phase_names[PHASE_COUNT] = { "lex", "parse", "eval" };
+
+typedef struct PhaseResult {
+	unsigned long median;
+	unsigned long p99;
+	unsigned long allocations; //median allocations of an iteration
+} PhaseResult;
+
+typedef struct Workload {
+	char name[64];
+	char *source;
+	size_t length;
+	PhaseResult phases[PHASE_COUNT];
+} Workload;
+
+static unsigned long now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long)ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+static int compare_samples(const void *a, const void *b){
+	unsigned long x = *(const unsigned long*)a, y = *(const unsigned long*)b;
+	return x < y ? -1 : x > y;
+}
+
+// Nearest rank percentile of sorted samples
+static unsigned long percentile(unsigned long *samples, int count, int percent){
+	int rank = (count * percent + 99) / 100;
+	return samples[rank > 0 ? rank - 1 : 0];
+}
+
+static char* read_file(const char *path, size_t *length){
+	FILE *f = fopen(path, "rb");
+	if(f == NULL) return NULL;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char *source = (char*)malloc(size + 1);
+	*length = fread(source, 1, size, f);
+	source[*length] = '\0';
+	fclose(f);
+	return source;
+}
+
+// Long source of independent statements with a function definition every hundred lines
+static char* generate_long_source(int lines, size_t *length){
+	size_t capacity = (size_t)lines * 64;
+	char *source = (char*)malloc(capacity);
+	size_t used = 0;
+	for(int i = 0; i < lines; i++){
+		if(i % 100 == 0)
+			used += snprintf(source + used, capacity - used, "fn g%d: x => return x * %d + (x %% 7)\n", i / 100, i % 13 + 1);
+		else
+			used += snprintf(source + used, capacity - used, "s%d = g%d(%d) - (%d * 3 + %d) / 2\n", i % 64, i / 100, i, i % 97, i % 5);
+	}
+	*length = used;
+	return source;
+}
+
+static bool run_iteration(Workload *workload, unsigned long samples[PHASE_COUNT], unsigned long allocations[PHASE_COUNT]){
+	Error error;
+	PjCompileStats stats;
+	PjProgram *program = pj_compile_stats(workload->source, &error, &stats);
+	if(program == NULL){
+		fprintf(stderr, "%s: %s [%u] %s\n", workload->name, error.err, error.type, error.message);
+		return false;
+	}
+	samples[PHASE_LEX] = stats.lex.nanoseconds;
+	allocations[PHASE_LEX] = stats.lex.allocations;
+	samples[PHASE_PARSE] = stats.parse.nanoseconds;
+	allocations[PHASE_PARSE] = stats.parse.allocations;
+
+	PjVM *vm = pj_vm_new();
+	unsigned long allocated = pj_allocations();
+	unsigned long start = now_ns();
+	RuntimeVal result = pj_vm_eval(vm, program);
+	samples[PHASE_EVAL] = now_ns() - start;
+	allocations[PHASE_EVAL] = pj_allocations() - allocated;
+	bool failed = is_error(result) && !is_none(result);
+	if(failed){
+		fprintf(stderr, "%s: ", workload->name);
+		fprint_runtime_val(stderr, result);
+	}
+	pj_vm_free(vm);
+	pj_program_free(program);
+	return !failed;
+}
+
+static bool run_workload(Workload *workload, int iterations){
+	unsigned long samples[PHASE_COUNT][iterations], allocations[PHASE_COUNT][iterations];
+	unsigned long sample[PHASE_COUNT], allocated[PHASE_COUNT];
+	//one untimed run warms the allocator and the caches
+	if(!run_iteration(workload, sample, allocated)) return false;
+	for(int i = 0; i < iterations; i++){
+		if(!run_iteration(workload, sample, allocated)) return false;
+		for(int phase = 0; phase < PHASE_COUNT; phase++){
+			samples[phase][i] = sample[phase];
+			allocations[phase][i] = allocated[phase];
+		}
+	}
+	for(int phase = 0; phase < PHASE_COUNT; phase++){
+		qsort(samples[phase], iterations, sizeof(unsigned long), compare_samples);
+		qsort(allocations[phase], iterations, sizeof(unsigned long), compare_samples);
+		workload->phases[phase].median = percentile(samples[phase], iterations, 50);
+		workload->phases[phase].p99 = percentile(samples[phase], iterations, 99);
+		workload->phases[phase].allocations = percentile(allocations[phase], iterations, 50);
+	}
+	return true;
+}
+
+/*===================== Reports =====================*/
+
+// One workload per line, so the baseline can be read back without a JSON parser
+static void write_json(FILE *out, Workload *workloads, int count, int iterations){
+	fprintf(out, "{\n  \"iterations\": %d,\n  \"workloads\": [\n", iterations);
+	for(int i = 0; i < count; i++){
+		fprintf(out, "    {\"name\": \"%s\", \"bytes\": %zu", workloads[i].name, workloads[i].length);
+		for(int phase = 0; phase < PHASE_COUNT; phase++){
+			PhaseResult *result = &workloads[i].phases[phase];
+			fprintf(out, ", \"%s\": {\"median_ns\": %lu, \"p99_ns\": %lu, \"allocations\": %lu}",
+				phase_names[phase], result->median, result->p99, result->allocations);
+		}
+		fprintf(out, "}%s\n", i + 1 < count ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+}
+
+// Results of a workload in a baseline written by write_json, false if the baseline does not have it
+static bool baseline_find(const char *baseline, const char *name, PhaseResult phases[PHASE_COUNT]){
+	char key[96];
+	snprintf(key, sizeof(key), "{\"name\": \"%s\",", name);
+	const char *line = strstr(baseline, key);
+	if(line == NULL) return false;
+	for(int phase = 0; phase < PHASE_COUNT; phase++){
+		snprintf(key, sizeof(key), "\"%s\": {", phase_names[phase]);
+		const char *fields = strstr(line, key);
+		if(fields == NULL) return false;
+		fields += strlen(key);
+		if(sscanf(fields, "\"median_ns\": %lu, \"p99_ns\": %lu, \"allocations\": %lu",
+			&phases[phase].median, &phases[phase].p99, &phases[phase].allocations) != 3) return false;
+	}
+	return true;
+}
+
+static double change(unsigned long now, unsigned long before){
+	return before == 0 ? 0 : ((double)now - before) * 100 / before;
+}
+
+static void print_table(Workload *workloads, int count, const char *baseline){
+	fprintf(stderr, "%-14s %-6s %12s %12s %12s", "workload", "phase", "median_us", "p99_us", "allocations");
+	if(baseline) fprintf(stderr, " %10s %10s", "median", "allocs");
+	fprintf(stderr, "\n");
+	for(int i = 0; i < count; i++){
+		PhaseResult before[PHASE_COUNT];
+		bool compared = baseline && baseline_find(baseline, workloads[i].name, before);
+		for(int phase = 0; phase < PHASE_COUNT; phase++){
+			PhaseResult *result = &workloads[i].phases[phase];
+			fprintf(stderr, "%-14s %-6s %12.1f %12.1f %12lu", workloads[i].name, phase_names[phase],
+				result->median / 1000.0, result->p99 / 1000.0, result->allocations);
+			if(compared)
+				fprintf(stderr, " %+9.1f%% %+9.1f%%", change(result->median, before[phase].median),
+					change(result->allocations, before[phase].allocations));
+			else if(baseline) fprintf(stderr, " %10s %10s", "new", "new");
+			fprintf(stderr, "\n");
+		}
+	}
+}
+
+int main(int argc, char **argv){
+	int iterations = BENCH_ITERATIONS;
+	const char *output = NULL, *baseline_path = NULL;
+	Workload *workloads = (Workload*)calloc(argc + 1, sizeof(Workload));
+	int count = 0;
+
+	for(int i = 1; i < argc; i++){
+		if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) iterations = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) output = argv[++i];
+		else if(strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) baseline_path = argv[++i];
+		else {
+			Workload *workload = &workloads[count];
+			workload->source = read_file(argv[i], &workload->length);
+			if(workload->source == NULL){
+				fprintf(stderr, "bench: cannot read %s\n", argv[i]);
+				return 1;
+			}
+			//workloads are named after the script, without directory and extension
+			const char *base = strrchr(argv[i], '/');
+			snprintf(workload->name, sizeof(workload->name), "%s", base ? base + 1 : argv[i]);
+			char *extension = strrchr(workload->name, '.');
+			if(extension) *extension = '\0';
+			count++;
+		}
+	}
+	if(iterations < 1){
+		fprintf(stderr, "bench: expected a positive iteration count\n");
+		return 1;
+	}
+	snprintf(workloads[count].name, sizeof(workloads[count].name), "long_source");
+	workloads[count].source = generate_long_source(LONG_SOURCE_LINES, &workloads[count].length);
+	count++;
+
+	for(int i = 0; i < count; i++)
+		if(!run_workload(&workloads[i], iterations)) return 1;
+
+	size_t length;
+	char *baseline = baseline_path ? read_file(baseline_path, &length) : NULL;
+	if(baseline_path && baseline == NULL) fprintf(stderr, "bench: cannot read baseline %s\n", baseline_path);
+	print_table(workloads, count, baseline);
+
+	FILE *out = output ? fopen(output, "w") : stdout;
+	if(out == NULL){
+		perror(output);
+		return 1;
+	}
+	write_json(out, workloads, count, iterations);
+	if(out != stdout) fclose(out);
+
+	for(int i = 0; i < count; i++) free(workloads[i].source);
+	free(workloads);
+	free(baseline);
+	return 0;
+}
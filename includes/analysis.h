@@ -0,0 +1,15 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+#include "./ast.h"
+
+//cost of an expression whose work cannot be bounded statically, e.g. a recursive call
+#define COST_UNBOUNDED 0xffffffffu
+
+//set by --fork-join, the only mode reading purity and cost. Otherwise programs are not analyzed
+//and every node keeps pure false
+extern bool analyze_purity;
+
+/*===================== ANALYSIS =====================*/
+void analyze_program(AST *root);
+void analyze_body(AST *function, AST *body);
+#endif
@@ -1,6 +1,7 @@
 #ifndef AST_H
 #define AST_H
 #include <stdbool.h>
+#include <stdatomic.h>
 #include "./enviroment.h"
 #include "./runtime_val.h"
 #include "../../data_structures/linked_list/linked_list.h"
@@ -35,6 +36,10 @@ typedef enum NodeType {
 	NODE_FUNCTION_SUB,
 	NODE_FUNCTION_MUL,
 	NODE_FUNCTION_DIV,
+	NODE_FUNCTION_PMAP,
+	NODE_FUNCTION_PREDUCE,
+	NODE_FUNCTION_PRINT,
+	NODE_FUNCTION_FLUSH,
 	NODE_VARIABLE,
 	NODE_ASSIGN,
 	NODE_FUNCTION,
@@ -42,12 +47,35 @@ typedef enum NodeType {
 	NODE_CALL,
 	NODE_RETURN,
 	NODE_BLOCK,
+	NODE_NATIVE,
+	NODE_SLICE,
+	NODE_TYPES
 } NodeType;
 
+//argument types a native function can declare, arguments are checked before the call
+typedef enum PjArgType {
+	PJ_ARG_ANY,
+	PJ_ARG_INT,
+	PJ_ARG_FLOAT, //ints are promoted
+	PJ_ARG_NUMBER,
+	PJ_ARG_BOOL,
+} PjArgType;
+
+//C function callable from scripts, args holds argc evaluated arguments
+typedef RuntimeVal (*PjNativeFn)(RuntimeVal *args, int argc, void *data);
+
+//braced function body the parser only scanned, it is parsed when the function is first called
+typedef struct LazyBody {
+	Node *start; //first token of the body, the tokens belong to the program
+	int site; //first of the sites reserved for the body
+	_Atomic(struct AST*) body; //NULL until parsed, the first parse to finish is kept
+	_Atomic(char*) error; //message of a body that does not parse, it is not parsed again
+} LazyBody;
+
 
 typedef union {
-	int i_value; // INT node
-	float f_value; // FLOAT node
+	int64_t i_value; // INT node
+	double f_value; // FLOAT node
 	bool b_value; // BOOLEAN node // TODO: add boolean nodes and update the code
 
 	List *statements; //block nodes 
@@ -58,23 +86,35 @@ typedef union {
 
 	Dictionary *properties; //for object nodes
 
+	RuntimeSlice slice; //slice nodes
+
 	struct AssignNodeVal {
 		char *vname;
 		struct AST *expr;
+		int site; //variable nodes, index of the reference site's inline cache
 	} var;
 
 	struct CallExprNode {
 		char *caller;
 		List *arguments;
+		int site; //index of the reference site's inline cache
 	} call_expr;
 
 	struct FunctionNodeVal {
 		char *fname;
-		struct AST *fbody; //represented by a root node of type block
+		struct AST *fbody; //represented by a root node of type block, NULL for lazy bodies
 		List *parameters; //list of strings
-		Enviroment *env; //functions scope
+		LazyBody *lazy; //body not parsed with the program, NULL when fbody is set
 	} fn;
 
+	struct NativeNodeVal {
+		char *name;
+		PjNativeFn fn;
+		int arity;
+		PjArgType *types; //one per argument
+		void *data; //passed back to fn on every call
+	} native;
+
 } NodeValue;
 
 typedef struct AST{
@@ -82,6 +122,8 @@ typedef struct AST{
 	NodeType type;
 	struct AST *left;
 	struct AST *right;
+	unsigned int cost; //estimated evaluation work, set by analyze_program
+	bool pure; //evaluation has no side effects, set by analyze_program
 
 } AST;
 
@@ -93,23 +135,28 @@ RuntimeVal	eval_binary_expr(AST *root, Enviroment* env);
 RuntimeVal	eval_boolean_expr(AST *root, Enviroment* env);
 RuntimeVal	eval_variable(AST *root, Enviroment* env);
 RuntimeVal 	eval_call_expr(AST *root, Enviroment *env);
+RuntimeVal	apply_function(struct PjVM *vm, AST *function, Enviroment *owner, RuntimeVal *args, int argc);
+RuntimeVal	binary_op(NodeType type, RuntimeVal left, RuntimeVal right);
+RuntimeVal	apply_native(AST *native, RuntimeVal *args, int argc);
 RuntimeVal	eval_number(AST *root, Enviroment* env);
 
 
 // node creation function
-AST* 			make_int_node(int value);
-AST* 			make_float_node(int value);
+AST* 			make_int_node(int64_t value);
+AST* 			make_float_node(double value);
 AST* 			make_bool_node(bool val);
 AST* 			make_object_node(Dictionary *properties);
 AST* 			make_block_node(List* statements);
 AST*			make_assign_node(char *vname, AST *expr);
 AST*			make_binop_node(NodeType type, AST *left, AST *right);
 AST*			make_if_node(AST *condition, AST *if_case, AST *else_case);
-AST*			make_func_node(char *fname, AST *fbody, List *parameters, Enviroment *env);
+AST*			make_func_node(char *fname, AST *fbody, List *parameters);
 AST*			make_var_node(char *vname);
 AST*			make_call_node(char *caller, List *arguments);
 AST*			make_return_node(AST *expr);
 AST*			make_operator_node(NodeType type, List *arguments);
+AST*			make_native_node(const char *name, PjNativeFn fn, int arity, const PjArgType *types, void *data);
+AST*			function_body(AST *function);
 
 //operators add, sub, mul, div
 RuntimeVal	builtin_function_add(AST *root, Enviroment *env);
@@ -117,6 +164,15 @@ RuntimeVal	builtin_function_sub(AST *root, Enviroment *env);
 RuntimeVal	builtin_function_mul(AST *root, Enviroment *env);
 RuntimeVal	builtin_function_div(AST *root, Enviroment *env);
 
+//parallel builtins pmap, preduce
+RuntimeVal	builtin_function_pmap(AST *root, Enviroment *env);
+RuntimeVal	builtin_function_preduce(AST *root, Enviroment *env);
+RuntimeVal	fork_binary_expr(AST *root, Enviroment *env);
+
+//output builtins print, flush
+RuntimeVal	builtin_function_print(AST *root, Enviroment *env);
+RuntimeVal	builtin_function_flush(AST *root, Enviroment *env);
+
 //utils functions
 bool 			is_binary_op(AST *root);
 bool 			is_number_node(AST *root);
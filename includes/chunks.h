@@ -0,0 +1,17 @@
+#ifndef CHUNKS_H
+#define CHUNKS_H
+#include <stdbool.h>
+#include "./vm.h"
+
+//sources are cut into about this many chunks per pool thread, so threads finishing early take more
+#define CHUNKS_PER_THREAD 4
+//smallest chunk worth a task, smaller sources are parsed in one piece
+#define CHUNK_MIN_BYTES (64 * 1024)
+
+//set by --parallel-parse, pj_compile cuts large sources into chunks of top level statements
+//and tokenizes and parses them on the thread pool
+extern bool parse_parallel;
+
+/*===================== CHUNKS =====================*/
+PjProgram*	pj_compile_chunks(const char *source, Error *error, PjCompileStats *stats);
+#endif
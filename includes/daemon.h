@@ -0,0 +1,46 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+#include <stddef.h>
+#include <pthread.h>
+#include "./vm.h"
+
+//compiled programs kept by the daemon
+#define DAEMON_CACHE_SIZE 64
+//connections handled at the same time
+#define DAEMON_WORKERS 4
+//accepted connections waiting for a worker
+#define DAEMON_BACKLOG 128
+//largest source a request may run or send, in bytes
+#define DAEMON_SOURCE_MAX (16 * 1024 * 1024)
+
+// Protocol, one request per connection:
+//   run <path>\n          evaluate the script at path
+//   eval <length>\n<src>  evaluate length bytes of source
+// every top level statement's result is written back as soon as it is evaluated,
+// compile errors as `error <err> [<type>] <message>`, and the response ends with `end`.
+// Requests for sources over DAEMON_SOURCE_MAX bytes are answered with `error <message>`
+
+//compiled program shared by the requests running it
+typedef struct CachedProgram {
+	unsigned long long hash; //FNV-1a of the source
+	char *source;
+	size_t length;
+	PjProgram *program;
+	int refs; //requests running the program, plus one while it is cached
+	struct CachedProgram *prev; //recency order, most recent first
+	struct CachedProgram *next;
+} CachedProgram;
+
+typedef struct ProgramCache {
+	CachedProgram *head;
+	CachedProgram *tail;
+	int count;
+	int capacity;
+	pthread_mutex_t lock;
+} ProgramCache;
+
+/*===================== DAEMON =====================*/
+int				pj_daemon_run(const char *socket_path, int workers);
+CachedProgram*	cache_acquire(ProgramCache *cache, const char *source, size_t length, Error *error);
+void				cache_release(ProgramCache *cache, CachedProgram *entry);
+#endif
@@ -0,0 +1,45 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+#include <stdio.h>
+#include <stdbool.h>
+
+//debug tracing is only compiled in with -DPJ_DEBUG (make DEBUG=1), release builds keep
+//neither the calls nor their arguments
+
+typedef enum {
+	DEBUG_LEXER,
+	DEBUG_PARSER,
+	DEBUG_EVAL,
+	DEBUG_ENV,
+	DEBUG_CATEGORIES
+} DebugCategory;
+
+//a category logs every message at or below the level it was switched on with
+typedef enum {
+	DEBUG_OFF,
+	DEBUG_INFO,
+	DEBUG_VERBOSE
+} DebugLevel;
+
+//messages kept in memory, older ones are overwritten
+#define DEBUG_RING 4096
+//characters kept of a message
+#define DEBUG_TEXT 120
+
+#ifdef PJ_DEBUG
+#define DEBUG_ENABLED 1
+extern DebugLevel debug_levels[DEBUG_CATEGORIES];
+#define DEBUG_LOG(category, level, ...) \
+	do { if(debug_levels[category] >= (level)) debug_log(category, level, __VA_ARGS__); } while(0)
+#else
+#define DEBUG_ENABLED 0
+#define DEBUG_LOG(category, level, ...) do {} while(0)
+#endif
+
+/*===================== DEBUG =====================*/
+#ifdef PJ_DEBUG
+void	debug_log(DebugCategory category, DebugLevel level, const char *format, ...) __attribute__((format(printf, 3, 4)));
+bool	debug_configure(const char *spec);
+void	debug_dump(FILE *out);
+#endif
+#endif
@@ -2,23 +2,45 @@
 #define ENV_H
 #include "../../data_structures/hash_table/hash_table.h"
 #include "../../data_structures/linked_list/linked_list.h"
+#include "./scope.h"
 
-typedef HashTable Dict;
+//scopes an inline cache can walk, deeper lookups are not cached
+#define IC_MAX_DEPTH 4
+
+struct PjVM;
 
 typedef struct Enviroment{
-	//key: variable name, value: AST* node
-	Dict *variables;
-	//key: function name, value: (params, function body)
-	Dict *fn_defs;
+	//key: name, value: variable AST* node and function AST* node
+	Scope *names;
 	struct Enviroment *parent;
+	struct PjVM *vm; //interpreter instance the scope belongs to, NULL while parsing
+	unsigned long version; //changes whenever a name becomes visible in the scope or entries move
 } Enviroment;
 
+//resolved lookup stored at a reference site. Every call evaluates a body in a fresh scope, so the
+//cache holds where the name was found instead of the scopes it was found from: depth scopes up, at
+//index of the owner's entries. A later lookup still finds it there if no scope below holds the name.
+//Programs an instance keeps number their sites alike, so a cache only serves the name and kind it was filled for
+typedef struct InlineCache {
+	char *name; //of the site that filled the cache, compared by address only
+	bool fn; //filled by a function lookup
+	Enviroment *owner; //scope holding the name
+	unsigned long version; //of owner when slot was taken
+	ScopeEntry *slot;
+	int index; //of slot in the owner's entries, the same in scopes given the same names in the same order
+	unsigned int hash; //scope_hash of the name
+	int depth; //number of scopes walked, 0 when the cache is empty
+} InlineCache;
+
 Enviroment*	env_init(int env_size);
 Enviroment*	create_global_env(int env_size);
+Enviroment*	env_new_scope(Enviroment *parent, struct PjVM *vm, int env_size);
+void			env_free(Enviroment *env);
 void*			env_assign_var(Enviroment *env, char *vname, void* value);
 void*			env_define_func(Enviroment *env, char *fname, void* fbody);
 void*			env_get_var(Enviroment *env, char *vname);
 void* 		env_get_function(Enviroment *env, char *fname);
 void*			env_call_func(Enviroment *env, char *fname, void* params);
 Enviroment*	env_get(Enviroment *env, char *fname);
+ScopeEntry*	env_lookup(Enviroment *env, char *name, bool fn, InlineCache *cache, Enviroment **owner);
 #endif
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "./vm.h"
+
+//compiled programs are saved as an image next to their source, later runs map the image
+//instead of tokenizing and parsing again. Images hold offsets instead of pointers, so the
+//same read only pages are shared by every process running the script
+#define IMAGE_MAGIC "PJIMAGE"
+//bump whenever the layout of ImageNode or the meaning of its fields changes
+#define IMAGE_VERSION 2
+//appended to the source path to name its image
+#define IMAGE_SUFFIX "c"
+
+//node and string references are stored as index + 1 or offset + 1, 0 stands for NULL.
+//Numbers are stored in the byte order of the machine that wrote the image
+typedef struct ImageHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t node_types; //NODE_TYPES of the writer, images of a build with other node types are stale
+	uint64_t hash; //of the source the image was compiled from
+	uint32_t nodes; //ImageNode records following the header
+	uint32_t words; //list words following the nodes, a list is its length followed by its items
+	uint32_t strings; //bytes of the string table following the words, every string is NUL terminated
+	uint32_t root;
+	int32_t sites;
+	int32_t functions;
+} ImageHeader;
+
+//children always come before their parent, so a node only refers to nodes already read
+typedef struct ImageNode {
+	uint32_t type;
+	uint32_t left;
+	uint32_t right;
+	uint32_t cost;
+	uint32_t pure;
+	int32_t site; //variable, assign and call nodes
+	uint32_t a; //low half of number bits, name string, single child or list, depending on type
+	uint32_t b; //high half of number bits, child of assigns and functions, argument list of calls
+	uint32_t c; //parameter list of functions, a list of strings
+} ImageNode;
+
+/*===================== IMAGE =====================*/
+uint64_t		pj_image_hash(const char *source, size_t length);
+bool			pj_image_write(const PjProgram *program, uint64_t hash, const char *path);
+PjProgram*	pj_image_load(const char *path, uint64_t hash);
+PjProgram*	pj_image_compile(const char *source, const char *source_path, Error *error);
+bool			image_save(const char *magic, AST *root, int sites, int functions, uint64_t hash, const char *path);
+PjProgram*	image_map(const char *path, const char *magic, uint64_t hash);
+#endif
@@ -0,0 +1,34 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+#include <stdbool.h>
+#include "./vm.h"
+
+//top level statement of the last compiled source, tokenized and parsed on its own so it can be
+//kept as long as the statement's text does not change
+typedef struct ParsedStatement {
+	char *text; //statement as written, keys the statements of the next compile
+	List *tokens; //lazily parsed bodies point into them
+	AST *block; //block of the statement, NULL for blank statements
+	int sites; //sites the statement numbered
+	int functions;
+	struct ParsedStatement *next; //later statement with the same text
+} ParsedStatement;
+
+//front end for sources compiled again after small edits, only statements that are new or
+//edited since the last compile are tokenized and parsed
+typedef struct PjIncremental {
+	ParsedStatement **statements; //of the last compiled source, in source order
+	int count;
+	int capacity;
+	int sites; //next free site, kept statements keep the sites they were numbered with
+	int live_sites; //sites numbered by the statements of the last source
+	PjProgram *program; //last compiled program
+	bool whole; //program was parsed in one piece and owns its AST
+	int parsed; //statements the last compile parsed, the others were kept
+} PjIncremental;
+
+/*===================== INCREMENTAL =====================*/
+PjIncremental*		pj_incremental_new(void);
+const PjProgram*	pj_incremental_compile(PjIncremental *inc, const char *source, Error *error);
+void					pj_incremental_free(PjIncremental *inc);
+#endif
@@ -0,0 +1,30 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+//subsystem an allocation is accounted to
+typedef enum {
+	MEM_LEXER, //tokens and their strings
+	MEM_PARSER, //parser state, compiled program and analysis
+	MEM_AST, //syntax tree nodes
+	MEM_ENV, //enviroments and scope tables
+	MEM_RUNTIME, //instances, inline caches, lists and value nodes made during evaluation
+	MEM_IO, //output buffers, input splitting and daemon requests
+	MEM_OTHER, //thread pool and profiler
+	MEM_TAGS
+} MemTag;
+
+/*===================== MEMORY =====================*/
+//every allocation made by the interpreter goes through these and must be freed with pj_free,
+//allocations of the linked list and hash table libraries are not counted
+void*				pj_malloc(MemTag tag, size_t size);
+void*				pj_calloc(MemTag tag, size_t count, size_t size);
+void*				pj_realloc(MemTag tag, void *ptr, size_t size);
+void				pj_free(void *ptr);
+void				pj_retag(void *ptr, MemTag tag);
+unsigned long	pj_allocations(void); //allocations made so far by the calling thread
+void				pj_mem_stats_enable(void);
+void				pj_mem_stats_report(FILE *out);
+#endif
@@ -0,0 +1,27 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+#include <stddef.h>
+#include "./runtime_val.h"
+
+//bytes collected before an instance writes its output
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+
+//output of an interpreter instance, written to fd when full, on flush and when the instance is freed
+typedef struct OutputBuffer {
+	char *data; //allocated on the first write
+	size_t length;
+	size_t capacity;
+	int fd; //-1 collects everything until the owner takes it, used by forked instances
+} OutputBuffer;
+
+/*===================== OUTPUT =====================*/
+void	output_init(OutputBuffer *out, int fd);
+void	output_write(OutputBuffer *out, const char *data, size_t length);
+void	output_str(OutputBuffer *out, const char *str);
+void	output_int(OutputBuffer *out, long long value);
+void	output_float(OutputBuffer *out, double value);
+void	output_value(OutputBuffer *out, RuntimeVal value);
+void	output_runtime_val(OutputBuffer *out, RuntimeVal value);
+void	output_flush(OutputBuffer *out);
+void	output_free(OutputBuffer *out);
+#endif
@@ -19,12 +19,21 @@ typedef struct Error{
 	ErrorType type;
 } Error;
 
+//returned by builtin_operators for names that are not builtin operators
+#define UNKNOWN_KEYWORD -1
+
 typedef struct Parser{
 	List *tokens; // list of Token*
 	Node *curr_token; //current token
 	int curr_tok_type;
+	int sites; //reference sites numbered so far
+	int functions; //function definitions parsed so far
+	bool lazy; //braced function bodies are only scanned, they are parsed on their first call
 } Parser;
 
+//parsers made by parser_init scan braced function bodies and parse them on their first call
+extern bool parse_lazily;
+
 /*===================== PARSER =====================*/
 Parser*	parser_init(List *tokens);
 int		is_parser_eof(Parser *parser);
@@ -49,10 +58,13 @@ List*		parse_arguments(Parser *parser, Enviroment* env, Error *error);
 AST*		parse_builtin_operator(Parser *parser, Enviroment* env, Error *error);
 void 		parse_error(int errorType, Error **error, char *message);
 NodeType builtin_operators(Token *token);
+bool		parser_shadows_builtin(Enviroment *env);
 
 void 		skip_newline(Parser *parser, Error *error);
-float		str_to_float(char *str);
-int		str_to_int(char *str);
+AST*		parser_site(Parser *parser, AST *node);
+AST*		parse_function_body(AST *function, Error *error);
+double	str_to_float(char *str);
+bool		str_to_int(char *str, int64_t *value);
 bool 		is_boolean_node(int type);
 bool 		is_logical(Token* token);
 int		logical_operator(Token *token);
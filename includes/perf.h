@@ -0,0 +1,52 @@
+#ifndef PERF_H
+#define PERF_H
+#include <stdbool.h>
+
+//counters opened as one group, those the cpu or kernel does not offer are left out
+typedef enum {
+	PERF_TASK_CLOCK, //nanoseconds on cpu, software counter available everywhere
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_BRANCHES,
+	PERF_BRANCH_MISSES,
+	PERF_L1D_MISSES, //L1 data cache read misses
+	PERF_LLC_MISSES, //last level cache read misses
+	PERF_COUNTERS
+} PerfCounter;
+
+typedef enum {
+	PERF_LEX,
+	PERF_PARSE,
+	PERF_EVAL,
+	PERF_PHASES
+} PerfPhase;
+
+//functions counted by name in --perf-counters=functions
+#define PERF_FUNCTIONS 256
+
+extern bool perf_enabled;
+extern bool perf_functions;
+
+void	perf_phase_record(PerfPhase phase, bool begin);
+void	perf_call_record(const char *name, bool enter);
+
+static inline void perf_phase_begin(PerfPhase phase){
+	if(perf_enabled) perf_phase_record(phase, true);
+}
+
+static inline void perf_phase_end(PerfPhase phase){
+	if(perf_enabled) perf_phase_record(phase, false);
+}
+
+static inline void perf_call_enter(const char *name){
+	if(perf_functions) perf_call_record(name, true);
+}
+
+static inline void perf_call_leave(const char *name){
+	if(perf_functions) perf_call_record(name, false);
+}
+
+/*===================== PERF =====================*/
+bool	perf_start(bool functions);
+void	perf_finish(void);
+#endif
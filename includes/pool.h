@@ -0,0 +1,36 @@
+#ifndef POOL_H
+#define POOL_H
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+typedef void (*PoolTaskFn)(void *arg);
+
+//tasks spawned together, pool_wait returns once all of them ran
+typedef struct TaskGroup {
+	atomic_int pending;
+} TaskGroup;
+
+typedef struct PoolTask {
+	PoolTaskFn fn;
+	void *arg;
+	TaskGroup *group;
+} PoolTask;
+
+//owner pushes and pops at the bottom, thieves steal from the top
+typedef struct TaskDeque {
+	PoolTask *tasks;
+	atomic_int top; //written under lock, read without it to skip empty deques
+	atomic_int bottom;
+	int capacity;
+	pthread_mutex_t lock;
+} TaskDeque;
+
+/*===================== POOL =====================*/
+void	pool_init(int threads);
+void	pool_shutdown(void);
+int	pool_size(void);
+void	pool_spawn(TaskGroup *group, PoolTaskFn fn, void *arg);
+void	pool_wait(TaskGroup *group);
+bool	pool_should_spawn(void);
+#endif
\ No newline at end of file
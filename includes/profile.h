@@ -0,0 +1,39 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+#include <stdbool.h>
+#include <signal.h>
+#include <stdatomic.h>
+
+//samples per second of cpu time
+#define PROFILE_HZ 997
+//frames kept per thread, deeper calls are counted but not recorded
+#define PROFILE_DEPTH 128
+//slots of the sample buffer, samples past it are dropped
+#define PROFILE_BUFFER (1 << 21)
+
+//script level call stack of a thread, read by the SIGPROF handler interrupting it
+typedef struct ProfileStack {
+	const char *frames[PROFILE_DEPTH];
+	volatile sig_atomic_t depth;
+} ProfileStack;
+
+extern bool profile_enabled;
+extern _Thread_local ProfileStack profile_stack;
+
+// Enter a script function, the frame is written before the depth so a sample never sees a stale one
+static inline void profile_push(const char *name){
+	if(!profile_enabled) return;
+	int depth = profile_stack.depth;
+	if(depth < PROFILE_DEPTH) profile_stack.frames[depth] = name;
+	atomic_signal_fence(memory_order_release);
+	profile_stack.depth = depth + 1;
+}
+
+static inline void profile_pop(void){
+	if(profile_enabled && profile_stack.depth > 0) profile_stack.depth--;
+}
+
+/*===================== PROFILE =====================*/
+bool	profile_start(const char *path, int hz);
+void	profile_finish(void);
+#endif
@@ -0,0 +1,11 @@
+#ifndef RECORDS_H
+#define RECORDS_H
+
+//fields f1, f2, ... a records expression can refer to
+#define RECORD_MAX_FIELDS 64
+//delimiter value splitting fields on runs of blanks, like awk's default
+#define RECORD_BLANKS -1
+
+/*===================== RECORDS =====================*/
+int pj_run_records(const char *expr, const char *path, int delimiter);
+#endif
@@ -1,8 +1,15 @@
 #ifndef RUNTIME_VAL
 #define RUNTIME_VAL
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
+//bytes of a larger buffer, never copied
+typedef struct RuntimeSlice {
+	const char *data;
+	int length;
+} RuntimeSlice;
+
 typedef struct RuntimeVal{
 	enum EvalNodeType {
 		RESULT_INT,
@@ -15,13 +22,18 @@ typedef struct RuntimeVal{
 		RESULT_ERROR_VALUE,
 		RESULT_ERROR_ZERO_DIV,
 		RESULT_FUNCTION,
+		RESULT_LIST,
+		RESULT_SLICE,
 	} type;
 
+	//ints are 64 bit, an int operation whose result does not fit is done again on doubles
 	union {
-		int i_value;
-		float f_value;
+		int64_t i_value;
+		double f_value;
 		bool b_value;
 		char *msg;
+		struct RuntimeList *list; //owned by the interpreter instance that produced it
+		RuntimeSlice slice;
 	} value;
 
 	bool retval; //boolean to hold if the runtime value is a returned expression
@@ -30,14 +42,23 @@ typedef struct RuntimeVal{
 
 } RuntimeVal;
 
+typedef struct RuntimeList {
+	RuntimeVal *items;
+	int size;
+} RuntimeList;
+
 /*===================== RuntimeVal =====================*/
 RuntimeVal 	coerce_to_float(RuntimeVal result);
 RuntimeVal 	coerce_to_int(RuntimeVal result);
+RuntimeVal 	slice_to_number(RuntimeVal result);
 RuntimeVal 	make_error(enum EvalNodeType type, char *msg);
 bool 			is_error(RuntimeVal val);
 bool 			is_number(RuntimeVal val);
 bool 			is_boolean(RuntimeVal val);
 bool 			is_none(RuntimeVal val);
 void 			print_runtime_val(RuntimeVal result);
+void 			print_value(RuntimeVal result);
+void 			fprint_runtime_val(FILE *out, RuntimeVal result);
+void 			fprint_value(FILE *out, RuntimeVal result);
 
 #endif 
@@ -0,0 +1,33 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+#include <stdbool.h>
+
+//scopes with at most this many names are searched linearly
+#define SCOPE_LINEAR_MAX 8
+
+typedef struct ScopeEntry {
+	char *name;
+	unsigned int hash;
+	unsigned int dist; //robin hood probe distance + 1, 0 marks an empty slot
+	void *var; //variable value, AST* node
+	void *fn; //function definition, AST* node
+} ScopeEntry;
+
+typedef struct Scope {
+	ScopeEntry *entries;
+	int count;
+	int capacity;
+	int size_hint; //initial capacity of the hashed table
+	bool hashed; //false while the scope is in linear mode
+	bool owns_names; //names are copied on insert, for scopes outliving the program that defined them
+} Scope;
+
+/*===================== SCOPE =====================*/
+Scope*		scope_init(int size_hint);
+void			scope_free(Scope *scope);
+void			scope_clear(Scope *scope, int size_hint);
+ScopeEntry*	scope_find(Scope *scope, char *name);
+ScopeEntry*	scope_find_hashed(Scope *scope, char *name, unsigned int hash);
+ScopeEntry*	scope_insert(Scope *scope, char *name, bool *created);
+unsigned int scope_hash(char *name);
+#endif
@@ -0,0 +1,14 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#include <stdbool.h>
+#include "./vm.h"
+
+//global scopes are saved in the image format under their own magic, as a block assigning every
+//variable its value followed by every function definition
+#define SNAPSHOT_MAGIC "PJSNAP"
+
+/*===================== SNAPSHOT =====================*/
+bool	pj_vm_snapshot(PjVM *vm, const char *path);
+bool	pj_vm_restore(PjVM *vm, const char *path);
+void	snapshot_move_sites(PjVM *vm, int first);
+#endif
@@ -0,0 +1,36 @@
+#ifndef STATS_H
+#define STATS_H
+#include <stdio.h>
+#include <stdbool.h>
+
+//execution statistics are only compiled in with -DPJ_STATS (make STATS=1),
+//otherwise the hooks expand to empty statements and evaluation pays nothing for them
+
+//scope depths counted apart, deeper lookups share the last one
+#define STATS_DEPTHS 8
+//functions counted by name, calls of any further ones are counted together
+#define STATS_FUNCTIONS 1024
+
+#ifdef PJ_STATS
+#define STATS_ENABLED 1
+#define STATS_NODE(type)				stats_node(type)
+#define STATS_LOOKUP(depth, cached)	stats_lookup(depth, cached)
+#define STATS_CALL_ENTER(name)		stats_call_enter(name)
+#define STATS_CALL_LEAVE()				stats_call_leave()
+#else
+#define STATS_ENABLED 0
+#define STATS_NODE(type)				((void)0)
+#define STATS_LOOKUP(depth, cached)	((void)0)
+#define STATS_CALL_ENTER(name)		((void)0)
+#define STATS_CALL_LEAVE()				((void)0)
+#endif
+
+/*===================== STATS =====================*/
+#ifdef PJ_STATS
+void	stats_node(int type);
+void	stats_lookup(int depth, bool cached);
+void	stats_call_enter(const char *name);
+void	stats_call_leave(void);
+void	stats_report(FILE *out);
+#endif
+#endif
@@ -0,0 +1,23 @@
+#ifndef STREAM_H
+#define STREAM_H
+#include <stddef.h>
+#include <stdbool.h>
+
+//cuts source arriving in pieces into complete top level statements,
+//a statement ends at a newline outside of any brace or parenthesis
+typedef struct StatementSplitter {
+	char *buffer;
+	size_t length;
+	size_t capacity;
+	size_t start; //first byte of the statement being collected
+	size_t scanned; //bytes of the current statement already scanned
+	int depth; //open braces and parentheses at scanned
+} StatementSplitter;
+
+/*===================== STREAM =====================*/
+void	splitter_init(StatementSplitter *splitter);
+void	splitter_feed(StatementSplitter *splitter, const char *data, size_t length);
+bool	splitter_next(StatementSplitter *splitter, const char **statement, size_t *length);
+bool	splitter_finish(StatementSplitter *splitter, const char **statement, size_t *length);
+void	splitter_free(StatementSplitter *splitter);
+#endif
@@ -0,0 +1,39 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <stdbool.h>
+
+//events kept per thread, older ones are overwritten once a thread records more
+#define TRACE_EVENTS (1 << 20)
+
+//begin or end of a span on the thread recording it
+typedef struct TraceEvent {
+	const char *name; //static or owned by a program that outlives the trace
+	unsigned long ns; //since the trace started
+	int arg; //statement index, -1 when the span has none
+	char phase; //'B' or 'E'
+} TraceEvent;
+
+//ring buffer of a thread, registered on its first event
+typedef struct TraceBuffer {
+	TraceEvent *events;
+	unsigned long count; //events recorded, the last TRACE_EVENTS of them are kept
+	int tid;
+	struct TraceBuffer *next;
+} TraceBuffer;
+
+extern bool trace_enabled;
+
+void	trace_record(const char *name, int arg, char phase);
+
+static inline void trace_begin(const char *name, int arg){
+	if(trace_enabled) trace_record(name, arg, 'B');
+}
+
+static inline void trace_end(const char *name){
+	if(trace_enabled) trace_record(name, -1, 'E');
+}
+
+/*===================== TRACE =====================*/
+void	trace_start(const char *path);
+void	trace_finish(void);
+#endif
@@ -0,0 +1,95 @@
+#ifndef VM_H
+#define VM_H
+#include "./tokenizer.h"
+#include "./parser.h"
+#include "./enviroment.h"
+#include "./ast.h"
+#include "./runtime_val.h"
+#include "./output.h"
+
+#define SYMBOL_SIZE 100
+//default estimated work an operand needs before fork join mode runs it as a task
+#define FORK_GRAIN 64
+
+//parsed program, never modified after pj_compile so instances can share it
+typedef struct PjProgram {
+	List *tokens; //token strings are referenced by the AST, NULL for programs loaded from an image
+	List *chunks; //token lists of a program parsed in chunks, instead of tokens
+	void *image; //mapped image whose string table the AST references instead
+	size_t image_size;
+	AST *root;
+	int sites; //number of variable and call sites
+	int functions; //function definitions, instances that ran the program point into its AST
+	unsigned long id; //unique per compiled program, keys the inline caches of an instance
+} PjProgram;
+
+//independent interpreter instance, owns every piece of mutable state used by evaluation
+typedef struct PjVM {
+	Enviroment *global;
+	InlineCache *caches; //indexed by reference site of the loaded program
+	int cache_count;
+	unsigned long program; //id of the program the caches were filled for
+	unsigned long clock; //source of scope versions
+	List *lists; //RuntimeList values produced by the last evaluation
+	bool owns_global; //false for instances forked to run parallel tasks
+	bool fork_join; //evaluate independent pure operands in parallel, the program must be compiled with analyze_purity set
+	unsigned int grain; //minimum estimated work of both operands before forking
+	Enviroment *spare_scopes; //freed scopes kept for reuse, linked through parent
+	AST *spare_nodes; //freed value nodes kept for reuse, linked through left
+	AST *natives; //registered native functions, linked through left
+	OutputBuffer out; //written by print, forked instances hand theirs to the parent on join
+	struct PjProgram *snapshot; //restored snapshot, global functions point into it
+	int snapshot_site; //first site of the restored functions, they are numbered after the loaded program's
+} PjVM;
+
+//function of a compiled program, valid as long as the program
+typedef struct PjFunction {
+	const PjProgram *program;
+	AST *node; //NULL when the program defines no such function
+} PjFunction;
+
+//argument buffer allocated once and refilled before every call
+typedef struct PjArgs {
+	RuntimeVal *values;
+	int count; //arguments passed by the next call
+	int capacity;
+} PjArgs;
+
+//receives the result of each statement evaluated by pj_vm_eval_each
+typedef void (*PjEmitFn)(RuntimeVal result, void *ctx);
+
+//cost of a single pj_call
+typedef struct PjCallStats {
+	unsigned long allocations; //allocations made by the calling thread during the call
+	unsigned long nanoseconds;
+} PjCallStats;
+
+//cost of each phase of a pj_compile_stats
+typedef struct PjCompileStats {
+	PjCallStats lex;
+	PjCallStats parse; //includes the analysis
+} PjCompileStats;
+
+/*===================== VM =====================*/
+PjProgram*	pj_compile(const char *source, Error *error);
+PjProgram*	pj_compile_stats(const char *source, Error *error, PjCompileStats *stats);
+void			pj_program_free(PjProgram *program);
+PjProgram*	vm_program_new(void);
+PjVM*			pj_vm_new(void);
+RuntimeVal	pj_vm_eval(PjVM *vm, const PjProgram *program);
+RuntimeVal	pj_vm_eval_each(PjVM *vm, const PjProgram *program, PjEmitFn emit, void *ctx);
+void			pj_vm_free(PjVM *vm);
+bool			pj_vm_register(PjVM *vm, const char *name, PjNativeFn fn, int arity, const PjArgType *types, void *data);
+PjFunction	pj_program_function(const PjProgram *program, const char *name);
+RuntimeVal	pj_call(PjVM *vm, PjFunction function, PjArgs *args, PjCallStats *stats);
+PjArgs*		pj_args_new(int capacity);
+void			pj_args_int(PjArgs *args, int index, int64_t value);
+void			pj_args_double(PjArgs *args, int index, double value);
+void			pj_args_free(PjArgs *args);
+InlineCache*	vm_site_cache(PjVM *vm, int site);
+RuntimeList*	vm_new_list(PjVM *vm, int size);
+PjVM*			vm_fork(PjVM *parent);
+void			vm_join(PjVM *parent, PjVM *child);
+AST*			vm_value_node(PjVM *vm, RuntimeVal value);
+void			vm_release_node(PjVM *vm, AST *node);
+#endif
\ No newline at end of file
@@ -1,74 +1,274 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "./includes/tokenizer.h"
 #include "./includes/parser.h"
 #include "./includes/enviroment.h"
 #include "./includes/runtime_val.h"
+#include "./includes/vm.h"
+#include "./includes/pool.h"
+#include "./includes/daemon.h"
+#include "./includes/stream.h"
+#include "./includes/records.h"
+#include "./includes/profile.h"
+#include "./includes/memory.h"
+#include "./includes/stats.h"
+#include "./includes/trace.h"
+#include "./includes/perf.h"
+#include "./includes/debug.h"
+#include "./includes/image.h"
+#include "./includes/snapshot.h"
+#include "./includes/chunks.h"
+#include "./includes/incremental.h"
+#include "./includes/analysis.h"
 
-#define BUFFER 256
+#define BUFFER 4096
 #define KEYWORD_SIZE 2
-#define SYMBOL_SIZE 100
+//how often --watch checks whether the script changed
+#define WATCH_INTERVAL_US 200000
 
 Error error_init();
-void 	print_token(void *t);
-int 	run(Enviroment *global_env);
+int 	run(PjVM *vm);
+int	watch(char *filepath, bool fork_join, int grain, char *restore);
 char* read_contents(char *filepath);
+void	print_reports(void);
+
+//reports printed on exit
+static bool mem_stats = false, exec_stats = false;
+static const char *debug = NULL;
 
 
 int main(int argc, char** argv){
-	Enviroment *global_env = create_global_env(SYMBOL_SIZE);
-	if(argc < 2) return run(global_env);
+	char *filepath = NULL, *socket_path = NULL, *expr = NULL, *records = NULL, *profile = NULL, *trace = NULL;
+	char *snapshot = NULL, *restore = NULL;
+	int delimiter = RECORD_BLANKS;
+	bool fork_join = false, perf_counters = false, perf_per_function = false, images = true, watching = false;
+	int grain = FORK_GRAIN, workers = DAEMON_WORKERS, profile_hz = PROFILE_HZ;
+	for(int i = 1; i < argc; i++){
+		//--threads N caps the threads used by pmap / preduce and fork join
+		if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) pool_init(atoi(argv[++i]));
+		else if(strncmp(argv[i], "--threads=", 10) == 0) pool_init(atoi(argv[i] + 10));
+		//--fork-join evaluates independent pure operands in parallel, --grain N sets the minimum work per task
+		//bodies are parsed up front in fork join mode, it needs every function analyzed with the whole program
+		else if(strcmp(argv[i], "--fork-join") == 0) fork_join = analyze_purity = true, parse_lazily = false;
+		//--parallel-parse tokenizes and parses large scripts a chunk of top level statements per thread
+		else if(strcmp(argv[i], "--parallel-parse") == 0) parse_parallel = true;
+		else if(strcmp(argv[i], "--grain") == 0 && i + 1 < argc) grain = atoi(argv[++i]);
+		else if(strncmp(argv[i], "--grain=", 8) == 0) grain = atoi(argv[i] + 8);
+		//--daemon=PATH serves scripts over a unix domain socket, --workers N requests at a time
+		else if(strcmp(argv[i], "--daemon") == 0 && i + 1 < argc) socket_path = argv[++i];
+		else if(strncmp(argv[i], "--daemon=", 9) == 0) socket_path = argv[i] + 9;
+		else if(strcmp(argv[i], "--workers") == 0 && i + 1 < argc) workers = atoi(argv[++i]);
+		else if(strncmp(argv[i], "--workers=", 10) == 0) workers = atoi(argv[i] + 10);
+		//-e EXPR --records FILE evaluates EXPR once per line of FILE, -F C splits fields on C
+		else if(strcmp(argv[i], "-e") == 0 && i + 1 < argc) expr = argv[++i];
+		else if(strcmp(argv[i], "--records") == 0 && i + 1 < argc) records = argv[++i];
+		else if(strncmp(argv[i], "--records=", 10) == 0) records = argv[i] + 10;
+		else if(strcmp(argv[i], "-F") == 0 && i + 1 < argc) delimiter = (unsigned char)argv[++i][0];
+		else if(strncmp(argv[i], "-F", 2) == 0 && argv[i][2]) delimiter = (unsigned char)argv[i][2];
+		//--profile[=FILE] samples script function stacks into folded stacks, --profile-hz N samples per second
+		else if(strcmp(argv[i], "--profile") == 0) profile = "profile.folded";
+		else if(strncmp(argv[i], "--profile=", 10) == 0) profile = argv[i] + 10;
+		else if(strcmp(argv[i], "--profile-hz") == 0 && i + 1 < argc) profile_hz = atoi(argv[++i]);
+		else if(strncmp(argv[i], "--profile-hz=", 13) == 0) profile_hz = atoi(argv[i] + 13);
+		//--trace=FILE writes a chrome trace of the phases, statements and function calls
+		else if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc) trace = argv[++i];
+		else if(strncmp(argv[i], "--trace=", 8) == 0) trace = argv[i] + 8;
+		//--perf-counters reads hardware counters around lex, parse and eval, =functions also per script function
+		else if(strcmp(argv[i], "--perf-counters") == 0) perf_counters = true;
+		else if(strcmp(argv[i], "--perf-counters=functions") == 0) perf_counters = perf_per_function = true;
+		//--mem-stats reports allocations per subsystem on exit
+		else if(strcmp(argv[i], "--mem-stats") == 0){
+			mem_stats = true;
+			pj_mem_stats_enable();
+		}
+		//--stats reports what evaluation did on exit, counted only by builds with -DPJ_STATS
+		else if(strcmp(argv[i], "--stats") == 0) exec_stats = true;
+		//--debug=CATEGORY[:LEVEL],... logs lexer, parser, eval or env messages, dumped on exit. Builds with -DPJ_DEBUG only
+		else if(strncmp(argv[i], "--debug=", 8) == 0) debug = argv[i] + 8;
+		//--no-image always compiles the script, neither reading nor writing the image next to it
+		else if(strcmp(argv[i], "--no-image") == 0) images = false;
+		//--snapshot FILE saves the globals the script defined, --restore FILE defines them before the script or REPL runs
+		else if(strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) snapshot = argv[++i];
+		else if(strncmp(argv[i], "--snapshot=", 11) == 0) snapshot = argv[i] + 11;
+		//--watch runs the script again every time it changes, parsing only the statements edited in between
+		else if(strcmp(argv[i], "--watch") == 0) watching = true;
+		else if(strcmp(argv[i], "--restore") == 0 && i + 1 < argc) restore = argv[++i];
+		else if(strncmp(argv[i], "--restore=", 10) == 0) restore = argv[i] + 10;
+		else filepath = argv[i];
+	}
+	if(exec_stats && !STATS_ENABLED) fprintf(stderr, "--stats: rebuild with -DPJ_STATS (make STATS=1) to count evaluation\n");
+	if(debug && !DEBUG_ENABLED) fprintf(stderr, "--debug: rebuild with -DPJ_DEBUG (make DEBUG=1) to log\n");
+#if DEBUG_ENABLED
+	if(debug && !debug_configure(debug)) return 1;
+#endif
+	if(socket_path) return pj_daemon_run(socket_path, workers);
+	if(expr && records){
+		int status = pj_run_records(expr, records, delimiter);
+		print_reports();
+		return status;
+	}
+	if(watching && filepath) return watch(filepath, fork_join, grain, restore);
+
+	//scripts and the REPL can be profiled and traced, the daemon and records mode run outside of it
+	if(profile) profile_start(profile, profile_hz);
+	if(trace) trace_start(trace);
+	if(perf_counters) perf_start(perf_per_function);
+	PjVM *vm = pj_vm_new();
+	vm->fork_join = fork_join;
+	vm->grain = grain > 0 ? grain : 1;
+	if(restore && !pj_vm_restore(vm, restore)){
+		fprintf(stderr, "%s: not a snapshot\n", restore);
+		pj_vm_free(vm);
+		return 1;
+	}
+	if(filepath == NULL){
+		int status = run(vm);
+		print_reports();
+		return status;
+	}
 
-	char *source = read_contents(argv[1]);
-	Parser *parser = parser_init(tokenize(source));
+	trace_begin("read_contents", -1);
+	char *source = read_contents(filepath);
+	trace_end("read_contents");
 	Error error = error_init();
 
-	// list_print(tokenize(source), print_token);
-	AST *program = parse_block(parser, global_env, false, &error);
+	PjProgram *program = images ? pj_image_compile(source, filepath, &error) : pj_compile(source, &error);
 	if(error.err != NULL){
 		printf("%s:[%u] %s\n", error.err, error.type, error.message);
+		print_reports();
 		return 0;
 	}
 
-	RuntimeVal runtime_res = eval_expr(program, global_env);
-	// print_runtime_val(runtime_res);
-	// print_ast(program, global_env, 0);
+	pj_vm_eval(vm, program);
+	if(snapshot && !pj_vm_snapshot(vm, snapshot)) fprintf(stderr, "%s: cannot save snapshot\n", snapshot);
+	profile_finish();
+	trace_finish();
+	perf_finish();
 
 	//free all allocated memory
-	free(source); ast_free(program);
-	free_list(parser->tokens, token_free); free(parser);
+	free(source); pj_program_free(program); pj_vm_free(vm);
+	print_reports();
 	return 0;
 }
 
 
-//runtime REPL
-int run(Enviroment *global_env){
-	char input[BUFFER] = {0};
+//runtime REPL, stdin is read in chunks and every complete statement runs as soon as it is read
+int run(PjVM *vm){
+	char chunk[BUFFER];
+	bool interactive = isatty(STDIN_FILENO);
+	StatementSplitter splitter;
+	splitter_init(&splitter);
+	//the tokenizer needs a terminated copy, reused for every statement
+	char *input = NULL;
+	size_t input_size = 0;
+	//functions point into their statement's program, those programs are kept until exit
+	List *programs = createList();
+
+	bool done = false;
+	while(!done){
+		if(interactive){
+			output_flush(&vm->out);
+			printf(splitter.depth > 0 ? "... " : ">>> ");
+			fflush(stdout);
+		}
+		ssize_t count = read(STDIN_FILENO, chunk, BUFFER);
+		if(count > 0) splitter_feed(&splitter, chunk, count);
+		done = count <= 0;
+
+		const char *statement;
+		size_t length;
+		while(done ? splitter_finish(&splitter, &statement, &length) : splitter_next(&splitter, &statement, &length)){
+			if(length + 2 > input_size){
+				input_size = length + 2;
+				input = realloc(input, input_size);
+			}
+			memcpy(input, statement, length);
+			//the parser expects every statement to end with a newline
+			if(statement[length - 1] != '\n') input[length++] = '\n';
+			input[length] = '\0';
+
+			Error error = error_init();
+			PjProgram *program = pj_compile(input, &error);
+			//results share the instance's buffer with print so they come out in order
+			if(error.err != NULL){
+				output_str(&vm->out, error.err);
+				output_str(&vm->out, " [");
+				output_int(&vm->out, error.type);
+				output_str(&vm->out, "] ");
+				output_str(&vm->out, error.message);
+				output_write(&vm->out, "\n", 1);
+				continue;
+			}
+			RuntimeVal runtime_res = pj_vm_eval(vm, program);
+			if(!is_none(runtime_res)) output_runtime_val(&vm->out, runtime_res);
+			if(program->functions > 0) list_push(programs, program);
+			else pj_program_free(program);
+		}
+	}
+
+	//frames point to the names of functions defined by the kept programs
+	profile_finish();
+	trace_finish();
+	perf_finish();
+	Node *curr = programs->head;
+	for(; curr != NULL; curr = curr->next) pj_program_free(curr->value);
+	list_free(programs);
+	splitter_free(&splitter);
+	free(input);
+	pj_vm_free(vm);
+	return 0;
+}
+
+//runs the script in a fresh instance whenever its size or modification time changes, until interrupted.
+//The front end keeps the statements of the last run, only new and edited ones are tokenized and parsed
+int watch(char *filepath, bool fork_join, int grain, char *restore){
+	PjIncremental *inc = pj_incremental_new();
+	struct stat last;
+	memset(&last, 0, sizeof(last));
 	while(true){
-		printf(">>> ");
-		fgets(input, BUFFER, stdin);
-		Parser *parser = parser_init(tokenize(input));
-		Error error = error_init();
-		AST *program = parse_statement(parser, global_env, false, &error);
-		if(error.err != NULL){
-			printf("%s [%u] %s\n", error.err, error.type, error.message);
+		struct stat info;
+		if(stat(filepath, &info) != 0 || (info.st_size == last.st_size && info.st_mtim.tv_sec == last.st_mtim.tv_sec &&
+			info.st_mtim.tv_nsec == last.st_mtim.tv_nsec)){
+			usleep(WATCH_INTERVAL_US);
 			continue;
 		}
+		last = info;
 
-		RuntimeVal runtime_res = eval_expr(program, global_env);
-		print_runtime_val(runtime_res);
-		
-		//free allocated memory
-		//TODO
+		char *source = read_contents(filepath);
+		Error error = error_init();
+		const PjProgram *program = pj_incremental_compile(inc, source, &error);
+		if(error.err != NULL) printf("%s:[%u] %s\n", error.err, error.type, error.message);
+		else {
+			if(inc->whole) fprintf(stderr, "watch: parsed the whole script\n");
+			else fprintf(stderr, "watch: parsed %d of %d statements\n", inc->parsed, inc->count);
+			//the program is replaced by the next compile, so the instance does not outlive this run
+			PjVM *vm = pj_vm_new();
+			vm->fork_join = fork_join;
+			vm->grain = grain > 0 ? grain : 1;
+			if(restore && !pj_vm_restore(vm, restore)) fprintf(stderr, "%s: not a snapshot\n", restore);
+			else pj_vm_eval(vm, program);
+			pj_vm_free(vm);
+		}
+		free(source);
+		fflush(stdout);
 	}
+	pj_incremental_free(inc);
 	return 0;
 }
 
-//helper function to print tokens
-void print_token(void *t){
-	Token *token = (Token*)t;
-	printf("%s", token_to_str(token));
+//reports asked for on the command line, live bytes left after freeing everything are leaks
+void print_reports(void){
+#if DEBUG_ENABLED
+	if(debug) debug_dump(stderr);
+#endif
+#if STATS_ENABLED
+	if(exec_stats) stats_report(stderr);
+#endif
+	if(mem_stats) pj_mem_stats_report(stderr);
 }
 
 //read contents of the source file
@@ -0,0 +1,216 @@
+#include <stdlib.h>
+#include "../includes/analysis.h"
+#include "../includes/scope.h"
+#include "../includes/memory.h"
+
+bool analyze_purity = false;
+
+/*===================== ANALYSIS =====================*/
+
+// Functions are matched to call sites by name, a name defined more than once
+// could resolve to either definition at runtime and is never treated as pure
+typedef struct FnInfo {
+	AST *node;
+	AST *body; //NULL for lazy bodies not parsed yet, they are never pure
+	bool pure;
+	int visit; //0 cost unknown, 1 cost being computed, 2 cost known
+	unsigned int cost;
+} FnInfo;
+
+typedef struct Analysis {
+	Scope *functions; //function name to FnInfo
+} Analysis;
+
+static unsigned int add_cost(unsigned int a, unsigned int b){
+	return a > COST_UNBOUNDED - b ? COST_UNBOUNDED : a + b;
+}
+
+static FnInfo* find_function(Analysis *analysis, char *name){
+	ScopeEntry *entry = scope_find(analysis->functions, name);
+	return entry ? entry->var : NULL;
+}
+
+// Iterator over the child expressions of a node
+typedef struct Children {
+	AST *fixed[3];
+	int count;
+	int index;
+	Node *list; //remaining list children of blocks, calls and builtin operators
+} Children;
+
+static Children children_of(AST *node){
+	Children children = { { NULL, NULL, NULL }, 0, 0, NULL };
+	if(is_builtin_operator(node)) 		children.list = node->value.arguments->head;
+	else if(node->type == NODE_BLOCK) 	children.list = node->value.statements->head;
+	else if(node->type == NODE_CALL)		children.list = node->value.call_expr.arguments->head;
+	else if(node->type == NODE_FUNCTION){
+		children.fixed[children.count++] = node->value.fn.fbody;
+	}
+	else if(node->type == NODE_IF_ELSE){
+		children.fixed[children.count++] = node->value.condition;
+		children.fixed[children.count++] = node->left;
+		children.fixed[children.count++] = node->right;
+	}
+	else if(node->type == NODE_RETURN)	children.fixed[children.count++] = node->value.return_expr;
+	else if(node->type == NODE_ASSIGN)	children.fixed[children.count++] = node->value.var.expr;
+	else {
+		children.fixed[children.count++] = node->left;
+		children.fixed[children.count++] = node->right;
+	}
+	return children;
+}
+
+// Advance to the next non NULL child, false once every child was visited
+static bool next_child(Children *children, AST **child){
+	while(children->index < children->count){
+		*child = children->fixed[children->index++];
+		if(*child) return true;
+	}
+	//blank lines leave NULL statements in blocks
+	while(children->list){
+		*child = children->list->value;
+		children->list = children->list->next;
+		if(*child) return true;
+	}
+	return false;
+}
+
+static void add_function(Analysis *analysis, AST *node, AST *body){
+	bool created;
+	ScopeEntry *entry = scope_insert(analysis->functions, node->value.fn.fname, &created);
+	if(created){
+		FnInfo *info = (FnInfo*)pj_calloc(MEM_PARSER, 1, sizeof(FnInfo));
+		info->node = node;
+		info->body = body;
+		info->pure = body != NULL;
+		entry->var = info;
+	}
+	else ((FnInfo*)entry->var)->pure = false;
+}
+
+// Record every function definition of the program, nested ones included
+static void collect_functions(Analysis *analysis, AST *node){
+	if(node->type == NODE_FUNCTION) add_function(analysis, node, node->value.fn.fbody);
+	Children children = children_of(node);
+	AST *child;
+	while(next_child(&children, &child)) collect_functions(analysis, child);
+}
+
+// Evaluation of node only writes scopes it creates itself, given the current purity of each function.
+// Assignments and definitions inside a function body land in the call's own scope
+static bool is_pure(Analysis *analysis, AST *node){
+	switch(node->type){
+		case NODE_FUNCTION_PMAP:
+		case NODE_FUNCTION_PREDUCE:
+		case NODE_FUNCTION_PRINT:
+		case NODE_FUNCTION_FLUSH:		return false;
+		case NODE_FUNCTION:				return true;
+		case NODE_CALL: {
+			FnInfo *info = find_function(analysis, node->value.call_expr.caller);
+			if(!info || !info->pure) return false;
+			break;
+		}
+		default: break;
+	}
+	Children children = children_of(node);
+	AST *child;
+	while(next_child(&children, &child))
+		if(!is_pure(analysis, child)) return false;
+	return true;
+}
+
+static unsigned int function_cost(Analysis *analysis, FnInfo *info);
+
+// Node count of the work an evaluation of node does, calls include the callee's body
+static unsigned int expr_cost(Analysis *analysis, AST *node){
+	if(node->type == NODE_FUNCTION) return 0;
+	unsigned int cost = 1;
+	if(node->type == NODE_CALL){
+		FnInfo *info = find_function(analysis, node->value.call_expr.caller);
+		if(info) cost = add_cost(cost, function_cost(analysis, info));
+	}
+	Children children = children_of(node);
+	AST *child;
+	while(cost != COST_UNBOUNDED && next_child(&children, &child))
+		cost = add_cost(cost, expr_cost(analysis, child));
+	return cost;
+}
+
+static unsigned int function_cost(Analysis *analysis, FnInfo *info){
+	//recursion depends on the arguments, nothing bounds it here
+	if(info->visit == 1) return COST_UNBOUNDED;
+	if(info->visit == 2) return info->cost;
+	if(info->body == NULL) return COST_UNBOUNDED;
+	info->visit = 1;
+	info->cost = expr_cost(analysis, info->body);
+	info->visit = 2;
+	return info->cost;
+}
+
+// Store purity and cost on every node, children first so each subtree is walked once
+static void annotate(Analysis *analysis, AST *node){
+	if(node->type == NODE_FUNCTION){
+		if(node->value.fn.fbody) annotate(analysis, node->value.fn.fbody);
+		node->pure = true;
+		node->cost = 0;
+		return;
+	}
+	bool pure = true;
+	unsigned int cost = 1;
+	Children children = children_of(node);
+	AST *child;
+	while(next_child(&children, &child)){
+		annotate(analysis, child);
+		pure = pure && child->pure;
+		cost = add_cost(cost, child->cost);
+	}
+	if(node->type == NODE_FUNCTION_PMAP || node->type == NODE_FUNCTION_PREDUCE ||
+		node->type == NODE_FUNCTION_PRINT || node->type == NODE_FUNCTION_FLUSH) pure = false;
+	if(node->type == NODE_CALL){
+		FnInfo *info = find_function(analysis, node->value.call_expr.caller);
+		pure = pure && info && info->pure;
+		if(info) cost = add_cost(cost, function_cost(analysis, info));
+	}
+	node->pure = pure;
+	node->cost = cost;
+}
+
+// Settle which collected functions are pure, then annotate root
+static void analyze(Analysis *analysis, AST *root){
+	//start from every function being pure and drop the ones that are not until nothing changes
+	Scope *functions = analysis->functions;
+	bool changed = true;
+	while(changed){
+		changed = false;
+		for(int i = 0; i < (functions->hashed ? functions->capacity : functions->count); i++){
+			FnInfo *info = functions->entries[i].dist ? functions->entries[i].var : NULL;
+			if(!info || !info->pure || is_pure(analysis, info->body)) continue;
+			info->pure = false;
+			changed = true;
+		}
+	}
+
+	annotate(analysis, root);
+	for(int i = 0; i < (functions->hashed ? functions->capacity : functions->count); i++)
+		if(functions->entries[i].dist) pj_free(functions->entries[i].var);
+	scope_free(functions);
+}
+
+// Mark which subexpressions can be evaluated independently and estimate their work,
+// runs once per program before it is shared between instances
+void analyze_program(AST *root){
+	if(!root || !analyze_purity) return;
+	Analysis analysis = { scope_init(DEFAULT_SIZE) };
+	collect_functions(&analysis, root);
+	analyze(&analysis, root);
+}
+
+// Analyze the body of a lazily parsed function before it is published. Only the function itself
+// and the functions nested in it are known, calls to any other function count as impure
+void analyze_body(AST *function, AST *body){
+	if(!body || !analyze_purity) return;
+	Analysis analysis = { scope_init(DEFAULT_SIZE) };
+	add_function(&analysis, function, body);
+	collect_functions(&analysis, body);
+	analyze(&analysis, body);
+}
@@ -3,26 +3,36 @@
 #include <math.h>
 #include <string.h>
 #include "../includes/ast.h"
+#include "../includes/vm.h"
+#include "../includes/pool.h"
+#include "../includes/memory.h"
+#include "../includes/profile.h"
+#include "../includes/stats.h"
+#include "../includes/trace.h"
+#include "../includes/perf.h"
+#include "../includes/debug.h"
 
 /*===================== Evaluation =====================*/
 
 // Initialize an abstract syntax tree node with given type, value, left and right nodes
 AST* ast_init(NodeType type, AST *left, AST *right){
-	AST *ast = (AST*)malloc(sizeof(AST)); 
+	AST *ast = (AST*)pj_malloc(MEM_AST, sizeof(AST)); 
 	ast->type = type; 
 	ast->left = left; 
 	ast->right = right;
+	ast->cost = 0;
+	ast->pure = false;
 	return ast; 
 }
 
 //create a node with type of int
-AST* make_int_node(int val){
+AST* make_int_node(int64_t val){
 	AST *node = ast_init(NODE_INT, NULL, NULL);
 	node->value.i_value = val;
 	return node;
 }
 //create a node with type of float
-AST* make_float_node(int val){
+AST* make_float_node(double val){
 	AST *node = ast_init(NODE_FLOAT, NULL, NULL);
 	node->value.f_value = val;
 	return node;
@@ -56,18 +66,25 @@ AST* make_if_node(AST *condition, AST *if_case, AST *else_case){
 	return ifnode;
 }
 
-AST* make_func_node(char *fname, AST *fbody, List *parameters, Enviroment *env){
+AST* make_func_node(char *fname, AST *fbody, List *parameters){
 	AST *func_node = ast_init(NODE_FUNCTION, NULL, NULL);
 	func_node->value.fn.fbody = fbody;
 	func_node->value.fn.fname = fname;
 	func_node->value.fn.parameters = parameters;
-	func_node->value.fn.env = env;
+	func_node->value.fn.lazy = NULL;
 	return func_node;
 }
 
+// Body of a function, NULL while a lazy body has not been parsed yet
+AST* function_body(AST *function){
+	if(function->value.fn.fbody || !function->value.fn.lazy) return function->value.fn.fbody;
+	return atomic_load_explicit(&function->value.fn.lazy->body, memory_order_acquire);
+}
+
 AST* make_var_node(char *vname){
 	AST *varnode = ast_init(NODE_VARIABLE, NULL, NULL);
 	varnode->value.var.vname = vname;
+	varnode->value.var.site = -1;
 	return varnode;
 }
 
@@ -75,6 +92,7 @@ AST* make_assign_node(char *vname, AST *expr){
 	AST *assign = ast_init(NODE_ASSIGN, NULL, NULL);
 	assign->value.var.vname = vname;
 	assign->value.var.expr = expr;
+	assign->value.var.site = -1;
 	return assign;
 }
 
@@ -88,6 +106,7 @@ AST *make_call_node(char *caller, List *arguments){
 	AST *call = ast_init(NODE_CALL, NULL, NULL);
 	call->value.call_expr.caller  = caller;
 	call->value.call_expr.arguments = arguments;
+	call->value.call_expr.site = -1;
 
 	return call;
 }
@@ -98,12 +117,26 @@ AST* make_operator_node(NodeType type, List *arguments){
 	return operator;
 }
 
+//create a node calling a C function, types may be NULL to accept any arguments
+AST* make_native_node(const char *name, PjNativeFn fn, int arity, const PjArgType *types, void *data){
+	AST *native = ast_init(NODE_NATIVE, NULL, NULL);
+	native->value.native.name = (char*)pj_malloc(MEM_AST, strlen(name) + 1);
+	strcpy(native->value.native.name, name);
+	native->value.native.fn = fn;
+	native->value.native.arity = arity;
+	native->value.native.types = (PjArgType*)pj_calloc(MEM_AST, arity > 0 ? arity : 1, sizeof(PjArgType));
+	if(types) memcpy(native->value.native.types, types, arity * sizeof(PjArgType));
+	native->value.native.data = data;
+	return native;
+}
+
 // evaluate the expresion represented by the abstract syntax tree and return the result
 RuntimeVal eval_expr(AST *root, Enviroment* env){
 
 	RuntimeVal result; result.type = RESULT_NONE;
 	result.retval = false;
 	if(root == NULL) return result;
+	STATS_NODE(root->type);
 	if(is_binary_op(root) && root->right == NULL)
 		return make_error(RESULT_ERROR_SYNTAX,  "Missing operand in binary operations");
 
@@ -117,10 +150,18 @@ RuntimeVal eval_expr(AST *root, Enviroment* env){
 	else if(root->type == NODE_FUNCTION_SUB) 	return builtin_function_sub(root, env);
 	else if(root->type == NODE_FUNCTION_MUL) 	return builtin_function_mul(root, env);
 	else if(root->type == NODE_FUNCTION_DIV) 	return builtin_function_div(root, env);
+	else if(root->type == NODE_FUNCTION_PMAP) 	return builtin_function_pmap(root, env);
+	else if(root->type == NODE_FUNCTION_PREDUCE) return builtin_function_preduce(root, env);
+	else if(root->type == NODE_FUNCTION_PRINT) 	return builtin_function_print(root, env);
+	else if(root->type == NODE_FUNCTION_FLUSH) 	return builtin_function_flush(root, env);
 	else if(root->type == NODE_BOOL){
 		result.type = RESULT_BOOL;
 		result.value.b_value = root->value.b_value;
 	}
+	else if(root->type == NODE_SLICE){
+		result.type = RESULT_SLICE;
+		result.value.slice = root->value.slice;
+	}
 	else if(root->type == NODE_BLOCK){
 		Node *statement = root->value.statements->head;
 		RuntimeVal stmnt; stmnt.type = RESULT_NONE; stmnt.retval = false;
@@ -134,6 +175,8 @@ RuntimeVal eval_expr(AST *root, Enviroment* env){
 	else if(root->type == NODE_IF_ELSE){
 		RuntimeVal result;
 		result.type = RESULT_INT;
+		//conditions are evaluated without going through eval_expr
+		if(root->value.condition) STATS_NODE(root->value.condition->type);
 		RuntimeVal condition = eval_boolean_expr(root->value.condition, env);
 		if(is_error(condition)) return condition;
 		if(condition.type != RESULT_BOOL)
@@ -145,19 +188,20 @@ RuntimeVal eval_expr(AST *root, Enviroment* env){
 
 	} 			
 	else if(root->type == NODE_ASSIGN){
-		print_ast(root, env, 0);
 		RuntimeVal result; result.type = RESULT_NONE;
 		result = eval_expr(root->value.var.expr, env);
+		DEBUG_LOG(DEBUG_EVAL, DEBUG_VERBOSE, "assign `%s` result type %d", root->value.var.vname, result.type);
 		AST *value = NULL;
-		if(result.type  == RESULT_INT) 				value = 	make_int_node(result.value.i_value);
-		else if(result.type == RESULT_FLOAT) 		value = 	make_int_node(result.value.f_value);
+		if(result.type  == RESULT_INT) 				value = 	vm_value_node(env->vm, result);
+		else if(result.type == RESULT_FLOAT) 		value = 	vm_value_node(env->vm, result);
+		else if(result.type == RESULT_SLICE) 		value = 	vm_value_node(env->vm, result);
 		else make_error(RESULT_ERROR_UNDEFINED, "Undefined assignment of function to variable");
 
 		env_assign_var(env, root->value.var.vname, value);
 		return result;
 	}
 	else if(root->type == NODE_FUNCTION){
-		if(!root->value.fn.fbody) 
+		if(!root->value.fn.fbody && !root->value.fn.lazy)
 			return make_error(RESULT_ERROR_VALUE, "Cannot evaluate function");
 		char *fname = root->value.fn.fname;
 		env_define_func(env, fname, root);
@@ -173,6 +217,7 @@ RuntimeVal eval_expr(AST *root, Enviroment* env){
 
 RuntimeVal	eval_number(AST *root, Enviroment* env){
 	RuntimeVal result;
+	result.retval = false;
 	result.type = RESULT_ERROR;
 	if(root == NULL || (root->type != NODE_FLOAT && root->type != NODE_INT))
 		return make_error(RESULT_ERROR_VALUE, "call to eval_number must be FLOAT | INT");
@@ -189,60 +234,90 @@ RuntimeVal	eval_number(AST *root, Enviroment* env){
 }
 
 RuntimeVal eval_binary_expr(AST *root, Enviroment *env){
-	RuntimeVal result;
-	result.type = RESULT_INT;
+	//independent pure operands worth a task are split across threads in fork join mode
+	PjVM *vm = env->vm;
+	if(vm && vm->fork_join && root->left->pure && root->right->pure &&
+		root->left->cost >= vm->grain && root->right->cost >= vm->grain && pool_should_spawn())
+		return fork_binary_expr(root, env);
+
 	RuntimeVal left = eval_expr(root->left, env);
 	RuntimeVal right = eval_expr(root->right, env);
+	return binary_op(root->type, left, right);
+}
+
+// Raise base to a non negative exponent by squaring, false when the power does not fit in an int
+static bool int_pow(int64_t base, int64_t exponent, int64_t *power){
+	int64_t result = 1;
+	while(exponent > 0){
+		if((exponent & 1) && __builtin_mul_overflow(result, base, &result)) return false;
+		exponent >>= 1;
+		if(exponent > 0 && __builtin_mul_overflow(base, base, &base)) return false;
+	}
+	*power = result;
+	return true;
+}
+
+// Apply an arithmetic operator to two ints, false when the result does not fit in an int
+static bool int_op(NodeType type, int64_t left, int64_t right, int64_t *result){
+	switch(type){
+		case NODE_ADD:			return !__builtin_add_overflow(left, right, result);
+		case NODE_SUB:			return !__builtin_sub_overflow(left, right, result);
+		case NODE_MUL:			return !__builtin_mul_overflow(left, right, result);
+		case NODE_DIV:
+			if(left == INT64_MIN && right == -1) return false;
+			*result = left / right;
+			return true;
+		case NODE_MODULUS:
+			*result = right == -1 ? 0 : left % right;
+			return true;
+		case NODE_POW:			return right >= 0 && int_pow(left, right, result);
+		default:					return false;
+	}
+}
+
+static double float_op(NodeType type, double left, double right){
+	switch(type){
+		case NODE_ADD:			return left + right;
+		case NODE_SUB:			return left - right;
+		case NODE_MUL:			return left * right;
+		case NODE_DIV:			return left / right;
+		case NODE_POW:			return pow(left, right);
+		default:					return 0;
+	}
+}
+
+// apply an arithmetic operator to two evaluated operands. ints stay ints as long as the result fits,
+// an int operation that overflows, a negative int exponent included, is done again on doubles
+RuntimeVal binary_op(NodeType type, RuntimeVal left, RuntimeVal right){
+	RuntimeVal result;
+	result.retval = false;
+	result.type = RESULT_INT;
 	//check for errors
 	if(is_error(left) ||is_error(right)) 
 		return is_error(left) ? left : right;
+	left = slice_to_number(left);
+	right = slice_to_number(right);
+	if(!is_number(left) || !is_number(right))
+		return make_error(RESULT_ERROR_VALUE, "Unsupported operation on operands");
 
-	if(left.type == RESULT_FLOAT || right.type == RESULT_FLOAT){
-		left = coerce_to_float(left);
-		right = coerce_to_float(right);
-		result.type = RESULT_FLOAT;
+	//modulus works on ints only
+	if(type == NODE_MODULUS){
+		left = coerce_to_int(left);
+		right = coerce_to_int(right);
 	}
 
-	//check for division by zero error
-	if((root->type == NODE_DIV || root->type == NODE_MODULUS))
-		if(coerce_to_int(right).value.i_value == 0)
+	if(left.type == RESULT_INT && right.type == RESULT_INT){
+		//check for division by zero error
+		if((type == NODE_DIV || type == NODE_MODULUS) && right.value.i_value == 0)
 			return make_error(RESULT_ERROR_ZERO_DIV, "division by zero is not allowed.");
-
-	if(root->type == NODE_ADD){
-		if(left.type == RESULT_FLOAT && right.type == RESULT_FLOAT)
-			result.value.f_value = left.value.f_value + right.value.f_value;
-		else if(left.type == RESULT_INT && right.type == RESULT_INT)
-			result.value.i_value = left.value.i_value + right.value.i_value;
-	}
-	else if(root->type == NODE_SUB){
-		if(left.type == RESULT_FLOAT && right.type == RESULT_FLOAT)
-			result.value.f_value = left.value.f_value - right.value.f_value;
-		else if(left.type == RESULT_INT && right.type == RESULT_INT)
-			result.value.i_value = left.value.i_value - right.value.i_value;
-	}
-	else if(root->type == NODE_DIV){
-		if(left.type == RESULT_FLOAT && right.type == RESULT_FLOAT)
-			result.value.f_value = left.value.f_value / right.value.f_value;
-		else if(left.type == RESULT_INT && right.type == RESULT_INT)
-			result.value.i_value = left.value.i_value / right.value.i_value;
-	}
-	else if(root->type == NODE_MUL){
-		if(left.type == RESULT_FLOAT && right.type == RESULT_FLOAT)
-			result.value.f_value = left.value.f_value * right.value.f_value;
-		else if(left.type == RESULT_INT && right.type == RESULT_INT)
-			result.value.i_value = left.value.i_value * right.value.i_value;
-	}
-	else if(root->type == NODE_MODULUS){
-		result.value.i_value = coerce_to_int(left).value.i_value % coerce_to_int(right).value.i_value;
-		result.type = RESULT_INT;
-	}
-	else if(root->type == NODE_POW){
-		if(left.type == RESULT_FLOAT && right.type == RESULT_FLOAT)
-			result.value.f_value = (float)pow(left.value.f_value, right.value.f_value);
-		else if(left.type == RESULT_INT && right.type == RESULT_INT)
-			result.value.i_value = (int)pow(left.value.i_value, right.value.i_value);
+		if(int_op(type, left.value.i_value, right.value.i_value, &result.value.i_value))
+			return result;
 	}
+	else if(type == NODE_DIV && coerce_to_float(right).value.f_value == 0)
+		return make_error(RESULT_ERROR_ZERO_DIV, "division by zero is not allowed.");
 
+	result.value.f_value = float_op(type, coerce_to_float(left).value.f_value, coerce_to_float(right).value.f_value);
+	result.type = RESULT_FLOAT;
 	return result;
 }
 
@@ -253,8 +328,12 @@ RuntimeVal eval_unary_expr(AST *root, Enviroment* env){
 	if(is_error(result)) return result;
 
 	if(root->type == NODE_UNARY_MINUS){
-		 if(result.type == RESULT_INT) result.value.i_value *= -1;
-		 else if(result.type == RESULT_FLOAT) result.value.f_value *= -1;
+		//the smallest int has no negation in range, it is negated as a double
+		if(result.type == RESULT_INT && __builtin_sub_overflow(0, result.value.i_value, &result.value.i_value)){
+			result.value.f_value = -(double)INT64_MIN;
+			result.type = RESULT_FLOAT;
+		}
+		else if(result.type == RESULT_FLOAT) result.value.f_value *= -1;
 	}
 	else if(root->type == NODE_UNARY_NOT){
 		if(result.type == RESULT_BOOL)
@@ -270,51 +349,106 @@ RuntimeVal eval_unary_expr(AST *root, Enviroment* env){
 	return result;
 }
 
+//comparison operators as the orderings they hold for, bit 0 when left < right, bit 1 when equal, bit 2 when left > right
+static const unsigned char comparison_masks[NODE_TYPES] = {
+	[NODE_LT] = 1, [NODE_EQUALS] = 2, [NODE_LTE] = 3, [NODE_GT] = 4, [NODE_NOT_EQUALS] = 5, [NODE_GTE] = 6,
+};
+
+// Order of an int and a double that is not NaN, -1, 0 or 1. Ints past 2^53 do not fit in a double,
+// so the int is compared with the whole part of the double and the fraction breaks ties
+static int order_int_double(int64_t i, double d){
+	if(d >= 9223372036854775808.0) return -1;
+	if(d < -9223372036854775808.0) return 1;
+	int64_t whole = (int64_t)d;
+	if(i != whole) return (i > whole) - (i < whole);
+	double fraction = d - (double)whole;
+	return (fraction < 0) - (fraction > 0);
+}
+
+// Result of a comparison whose operands are ordered by order, -1, 0 or 1
+static RuntimeVal comparison(NodeType type, int order){
+	RuntimeVal result;
+	result.retval = false;
+	result.type = RESULT_BOOL;
+	result.value.b_value = (comparison_masks[type] >> (order + 1)) & 1;
+	return result;
+}
+
+// Truth of an and / or operand, numbers are true when their integer part is not 0
+static bool truth_value(RuntimeVal value){
+	return is_boolean(value) ? value.value.b_value : coerce_to_int(value).value.i_value != 0;
+}
+
+// and / or only evaluate the right operand when the left one does not decide the result
+static RuntimeVal eval_logic_expr(AST *root, Enviroment *env){
+	bool is_and = root->type == NODE_AND;
+	RuntimeVal left = slice_to_number(eval_expr(root->left, env));
+	if(is_error(left)) return left;
+	if(!is_number(left) && !is_boolean(left))
+		return make_error(RESULT_ERROR_VALUE, "Unsupported operation on operands");
+
+	RuntimeVal result;
+	result.retval = false;
+	result.type = RESULT_BOOL;
+	result.value.b_value = truth_value(left);
+	if(result.value.b_value != is_and) return result;
+
+	RuntimeVal right = slice_to_number(eval_expr(root->right, env));
+	if(is_error(right)) return right;
+	//operands are both booleans or both numbers
+	if(is_boolean(left) != is_boolean(right) || (!is_number(right) && !is_boolean(right)))
+		return make_error(RESULT_ERROR_VALUE, "Unsupported operation on operands");
+	result.value.b_value = truth_value(right);
+	return result;
+}
+
 RuntimeVal	eval_boolean_expr(AST *root, Enviroment* env){
+	if(root->type == NODE_AND || root->type == NODE_OR) return eval_logic_expr(root, env);
 	RuntimeVal result;
+	result.retval = false;
 	result.type = RESULT_BOOL;
 	RuntimeVal left = eval_expr(root->left, env);
 	RuntimeVal right = eval_expr(root->right, env);
+	//ints compare exactly, without going through float
+	if(left.type == RESULT_INT && right.type == RESULT_INT)
+		return comparison(root->type, (left.value.i_value > right.value.i_value) - (left.value.i_value < right.value.i_value));
 	//check for errors
 	if(is_error(left) ||is_error(right)) 
 			return is_error(left) ? left : right;
+	//two slices compare as text for equality, otherwise slices compare as numbers
+	if(left.type == RESULT_SLICE && right.type == RESULT_SLICE && (root->type == NODE_EQUALS || root->type == NODE_NOT_EQUALS)){
+		bool equal = left.value.slice.length == right.value.slice.length &&
+			memcmp(left.value.slice.data, right.value.slice.data, left.value.slice.length) == 0;
+		result.value.b_value = root->type == NODE_EQUALS ? equal : !equal;
+		return result;
+	}
+	left = slice_to_number(left);
+	right = slice_to_number(right);
 	if((!is_number(left) || !is_number(right)) && (!is_boolean(left) || !is_boolean(right)))
 		return make_error(RESULT_ERROR_VALUE, "Unsupported operation on operands");
 
-	if(root->type == NODE_GT)
-		result.value.b_value = coerce_to_float(left).value.f_value > coerce_to_float(right).value.f_value;
-	else if(root->type == NODE_GTE)
-		result.value.b_value = coerce_to_float(left).value.f_value >= coerce_to_float(right).value.f_value;
-	else if(root->type == NODE_LT)
-		result.value.b_value = coerce_to_float(left).value.f_value < coerce_to_float(right).value.f_value;
-	else if(root->type == NODE_LTE)
-		result.value.b_value = coerce_to_float(left).value.f_value <= coerce_to_float(right).value.f_value;
-	else if(root->type == NODE_EQUALS)
-		result.value.b_value = coerce_to_float(left).value.f_value == coerce_to_float(right).value.f_value;
-	else if(root->type == NODE_NOT_EQUALS)
-		result.value.b_value = coerce_to_float(left).value.f_value != coerce_to_float(right).value.f_value;
-	else if(root->type == NODE_OR){
-		if(is_boolean(left) && is_boolean(right))
-			result.value.b_value = left.value.b_value || right.value.b_value;
-		else if(is_number(left) || is_number(right))
-			result.value.b_value = coerce_to_int(left).value.i_value ||  coerce_to_int(right).value.i_value;
-	}
-	else if(root->type == NODE_AND){
-		if(is_boolean(left) && is_boolean(right))
-			result.value.b_value = left.value.b_value && right.value.b_value;
-		else if(is_number(left) && is_number(right))
-			result.value.b_value = coerce_to_int(left).value.i_value && coerce_to_int(right).value.i_value;
+	if(is_boolean(left))
+		return comparison(root->type, left.value.b_value - right.value.b_value);
+	if(left.type == RESULT_INT && right.type == RESULT_INT)
+		return comparison(root->type, (left.value.i_value > right.value.i_value) - (left.value.i_value < right.value.i_value));
+	//NaN is only unequal
+	if((left.type == RESULT_FLOAT && isnan(left.value.f_value)) || (right.type == RESULT_FLOAT && isnan(right.value.f_value))){
+		result.value.b_value = root->type == NODE_NOT_EQUALS;
+		return result;
 	}
-
-	return result;
+	if(left.type == RESULT_INT) return comparison(root->type, order_int_double(left.value.i_value, right.value.f_value));
+	if(right.type == RESULT_INT) return comparison(root->type, -order_int_double(right.value.i_value, left.value.f_value));
+	double l = left.value.f_value, r = right.value.f_value;
+	return comparison(root->type, (l > r) - (l < r));
 }
 
 RuntimeVal eval_variable(AST *root, Enviroment* env){
-	AST *variable = env_get_var(env, root->value.var.vname);
-	if(variable) 
-		return eval_expr(variable, env);
+	InlineCache *cache = vm_site_cache(env->vm, root->value.var.site);
+	ScopeEntry *entry = env_lookup(env, root->value.var.vname, false, cache, NULL);
+	if(entry) 
+		return eval_expr(entry->var, env);
 
-	variable = env_get_function(env, root->value.var.vname);
+	AST *variable = env_get_function(env, root->value.var.vname);
 	if(variable) 
 		return eval_call_expr(root, env);
 
@@ -325,44 +459,115 @@ RuntimeVal 	eval_call_expr(AST *root, Enviroment *env){
 	RuntimeVal result;
 	result.type = RESULT_ERROR_UNDEFINED;
 	if(root == NULL) return result;
-	AST *function = env_get_function(env, root->value.call_expr.caller);
+	Enviroment *owner = NULL;
+	InlineCache *cache = vm_site_cache(env->vm, root->value.call_expr.site);
+	ScopeEntry *entry = env_lookup(env, root->value.call_expr.caller, true, cache, &owner);
+	if(entry == NULL) return make_error(RESULT_ERROR_UNDEFINED, root->value.call_expr.caller);
+	AST *function = entry->fn;
 	List *arguments = root->value.call_expr.arguments;
-	List *parameters = function->value.fn.parameters;
+	int arity = function->type == NODE_NATIVE ? function->value.native.arity : function->value.fn.parameters->size;
 
-	Node *arguments_iter = arguments->head;
-	Node *parameters_iter = parameters->head;
-	Enviroment *scope = function->value.fn.env; //initializing the functions enviroment
-	//defining the functions definion env as the functions parent scope
-	scope->parent = env_get(env, root->value.call_expr.caller); 
+	if(arguments->size < arity)
+		return make_error(RESULT_ERROR_VALUE, "Missing arguments");
+	else if(arguments->size > arity)
+		return make_error(RESULT_ERROR_VALUE, "Too many arguments provided");
+
+	//evaluting the arguments in the caller's enviroment
+	RuntimeVal values[arguments->size > 0 ? arguments->size : 1];
+	int argc = 0;
+	for(Node *argument = arguments->head; argument != NULL; argument = argument->next)
+		values[argc++] = eval_expr(argument->value, env);
+
+	return apply_function(env->vm, function, owner, values, argc);
+}
 
-	if(arguments->size < parameters->size)
+// Call a script function with evaluated arguments, owner is the scope that defines the function
+RuntimeVal apply_function(struct PjVM *vm, AST *function, Enviroment *owner, RuntimeVal *args, int argc){
+	if(function->type == NODE_NATIVE){
+		profile_push(function->value.native.name);
+		STATS_CALL_ENTER(function->value.native.name);
+		RuntimeVal result = apply_native(function, args, argc);
+		STATS_CALL_LEAVE();
+		profile_pop();
+		return result;
+	}
+	AST *body = function->value.fn.fbody;
+	if(body == NULL){
+		Error error;
+		body = parse_function_body(function, &error);
+		if(body == NULL) return make_error(RESULT_ERROR_SYNTAX, error.message);
+	}
+	List *parameters = function->value.fn.parameters;
+	if(argc < parameters->size)
 		return make_error(RESULT_ERROR_VALUE, "Missing arguments");
-	else if(arguments->size > parameters->size)
+	else if(argc > parameters->size)
 		return make_error(RESULT_ERROR_VALUE, "Too many arguments provided");
 
-	//evaluting the arguments and assigning them into the enviroment
-	while(arguments_iter && parameters_iter){
-		RuntimeVal evaluatedArg = eval_expr(arguments_iter->value, env);
-		AST *node = NULL;
-		if(evaluatedArg.type == RESULT_INT){
-			node = make_int_node(evaluatedArg.value.i_value);
-		}
-		else if(evaluatedArg.type == RESULT_FLOAT){
-			node = make_float_node(evaluatedArg.value.f_value);
+	//an argument that failed to evaluate reports its own error
+	for(int i = 0; i < argc; i++)
+		if(is_error(args[i]) && !is_none(args[i])) return args[i];
+
+	DEBUG_LOG(DEBUG_EVAL, DEBUG_VERBOSE, "call `%s` with %d arguments", function->value.fn.fname, argc);
+	//every call gets its own scope, its parent is the scope that defines the function
+	Enviroment *scope = env_new_scope(owner, vm, SCOPE_LINEAR_MAX);
+	Node *parameters_iter = parameters->head;
+	for(int i = 0; i < argc; i++, parameters_iter = parameters_iter->next){
+		AST *node = vm_value_node(vm, args[i]);
+		if(node == NULL){
+			env_free(scope);
+			return make_error(RESULT_ERROR_UNDEFINED, "nothing type value given");
 		}
-		else return make_error(RESULT_ERROR_UNDEFINED, "nothing type value given");
 		env_assign_var(scope, (char*)parameters_iter->value, node);
-
-		arguments_iter = arguments_iter->next;
-		parameters_iter = parameters_iter->next;
 	}
 
-	RuntimeVal returnedVal = eval_expr(function->value.fn.fbody, scope); //evaluating the functions body
-	if(returnedVal.retval) return returnedVal;
-	returnedVal.type = RESULT_NONE;
+	profile_push(function->value.fn.fname);
+	STATS_CALL_ENTER(function->value.fn.fname);
+	trace_begin(function->value.fn.fname, -1);
+	perf_call_enter(function->value.fn.fname);
+	RuntimeVal returnedVal = eval_expr(body, scope); //evaluating the functions body
+	perf_call_leave(function->value.fn.fname);
+	trace_end(function->value.fn.fname);
+	STATS_CALL_LEAVE();
+	profile_pop();
+	env_free(scope);
+	if(!returnedVal.retval) returnedVal.type = RESULT_NONE;
+	returnedVal.retval = false; //the return stops at the call site
 	return returnedVal;
 }
 
+// Call a C function with evaluated arguments, checked against its declared types in place
+RuntimeVal apply_native(AST *native, RuntimeVal *args, int argc){
+	struct NativeNodeVal *fn = &native->value.native;
+	if(argc < fn->arity)
+		return make_error(RESULT_ERROR_VALUE, "Missing arguments");
+	else if(argc > fn->arity)
+		return make_error(RESULT_ERROR_VALUE, "Too many arguments provided");
+
+	for(int i = 0; i < argc; i++){
+		if(is_error(args[i])) return args[i];
+		switch(fn->types[i]){
+			case PJ_ARG_INT:
+				if(args[i].type != RESULT_INT) return make_error(RESULT_ERROR_VALUE, "expected an int argument");
+				break;
+			case PJ_ARG_FLOAT:
+				if(!is_number(args[i])) return make_error(RESULT_ERROR_VALUE, "expected a float argument");
+				args[i] = coerce_to_float(args[i]);
+				break;
+			case PJ_ARG_NUMBER:
+				if(!is_number(args[i])) return make_error(RESULT_ERROR_VALUE, "expected a number argument");
+				break;
+			case PJ_ARG_BOOL:
+				if(!is_boolean(args[i])) return make_error(RESULT_ERROR_VALUE, "expected a boolean argument");
+				break;
+			default: break;
+		}
+	}
+
+	RuntimeVal result = fn->fn(args, argc, fn->data);
+	result.retval = false;
+	return result;
+}
+
 RuntimeVal builtin_function_sub(AST *root, Enviroment* env){
 	List *operands = root->value.arguments;
 	Node *curr = operands->head;
@@ -382,6 +587,8 @@ RuntimeVal builtin_function_sub(AST *root, Enviroment* env){
 
 RuntimeVal builtin_function_add(AST *root, Enviroment* env){
 	RuntimeVal result;
+	result.retval = false;
+	result.value.f_value = 0;
 	List *operands = root->value.arguments;
 	Node *curr = operands->head;
 	while(curr != NULL){ 
@@ -396,6 +603,7 @@ RuntimeVal builtin_function_add(AST *root, Enviroment* env){
 
 RuntimeVal builtin_function_mul(AST *root, Enviroment* env){
 	RuntimeVal result;
+	result.retval = false;
 	result.value.f_value = 1;
 	List *operands = root->value.arguments;
 	Node *curr = operands->head;
@@ -412,6 +620,7 @@ RuntimeVal builtin_function_mul(AST *root, Enviroment* env){
 RuntimeVal builtin_function_div(AST *root, Enviroment* env){
 	List *operands = root->value.arguments;
 	RuntimeVal result;
+	result.retval = false;
 	if(operands->size != 2)
 		return make_error(RESULT_ERROR_SYNTAX, "SyntaxError: `div` accepts exactly two arguments.");
 
@@ -425,12 +634,50 @@ RuntimeVal builtin_function_div(AST *root, Enviroment* env){
 	return result;
 }
 
+// Write the arguments separated by spaces and a newline to the instance's output
+RuntimeVal builtin_function_print(AST *root, Enviroment *env){
+	List *operands = root->value.arguments;
+	RuntimeVal values[operands->size > 0 ? operands->size : 1];
+	int count = 0;
+	//nothing is written when an argument fails
+	for(Node *curr = operands->head; curr != NULL; curr = curr->next){
+		values[count] = eval_expr(curr->value, env);
+		if(is_error(values[count]) && !is_none(values[count])) return values[count];
+		count++;
+	}
+
+	OutputBuffer *out = &env->vm->out;
+	for(int i = 0; i < count; i++){
+		if(i > 0) output_write(out, " ", 1);
+		output_value(out, values[i]);
+	}
+	output_write(out, "\n", 1);
+
+	RuntimeVal result;
+	result.type = RESULT_NONE;
+	result.retval = false;
+	return result;
+}
+
+RuntimeVal builtin_function_flush(AST *root, Enviroment *env){
+	if(root->value.arguments->size > 0) return make_error(RESULT_ERROR_SYNTAX, "`flush` accepts no arguments.");
+	output_flush(&env->vm->out);
+	RuntimeVal result;
+	result.type = RESULT_NONE;
+	result.retval = false;
+	return result;
+}
+
 // Check if node type is a keyword
 bool is_keyword(int type){
 	return type == NODE_FUNCTION_ADD ||
 			 type == NODE_FUNCTION_SUB || 
 			 type == NODE_FUNCTION_MUL || 
-			 type == NODE_FUNCTION_DIV;
+			 type == NODE_FUNCTION_DIV ||
+			 type == NODE_FUNCTION_PMAP ||
+			 type == NODE_FUNCTION_PREDUCE ||
+			 type == NODE_FUNCTION_PRINT ||
+			 type == NODE_FUNCTION_FLUSH;
 }
 
 bool is_binary_op(AST *root){
@@ -486,7 +733,7 @@ void print_node_type(AST *root) {
 		case NODE_POW: 				printf("pow:"); 													break;
 		case NODE_MODULUS: 			printf("modulus:"); 												break;
 		case NODE_FLOAT: 				printf("float(%.2f)", root->value.f_value); 				break;
-		case NODE_INT: 				printf("int(%d)", root->value.i_value); 					break;
+		case NODE_INT: 				printf("int(%lld)", (long long)root->value.i_value); 					break;
 		case NODE_OBJECT: 			printf("{"); 														break;
 		case NODE_VARIABLE: 			printf("var(`%s`)", root->value.var.vname); 				break;
 		case NODE_ASSIGN: 			printf("assign `%s`:", root->value.var.vname);			break;
@@ -501,6 +748,8 @@ void print_node_type(AST *root) {
 		case NODE_FUNCTION: 			 																		return;
 		case NODE_FUNC_VARIABLE: 	printf("fname(`%s`)", root->value.fn.fname); 			break;
 		case NODE_CALL: 				printf("<function_call %s>", root->value.fn.fname); 	break;
+		case NODE_NATIVE: 			printf("<native %s>", root->value.native.name); 			break;
+		case NODE_SLICE: 				printf("slice(%.*s)", root->value.slice.length, root->value.slice.data); break;
 		default: 						 																		break;
 	}
 }
@@ -512,6 +761,10 @@ void print_builtin_math_function(AST* root, Enviroment* env, int level) {
 	printf("%s(\n", root->type == NODE_FUNCTION_ADD ? "f_add"
 		: root->type == NODE_FUNCTION_SUB ? "f_sub"
 		: root->type == NODE_FUNCTION_MUL ? "f_mul"
+		: root->type == NODE_FUNCTION_PMAP ? "pmap"
+		: root->type == NODE_FUNCTION_PREDUCE ? "preduce"
+		: root->type == NODE_FUNCTION_PRINT ? "print"
+		: root->type == NODE_FUNCTION_FLUSH ? "flush"
 		: "f_div");  // Switch for function type
 	
 	Node* curr = operands->head;
@@ -629,8 +882,7 @@ void print_ast(AST* root, Enviroment* env, int level) {
 	}
 
 	// For unary operators, recursive printing with appropriate indentation
-	if (root->type == NODE_FUNCTION_ADD || root->type == NODE_FUNCTION_SUB ||
-		root->type == NODE_FUNCTION_MUL || root->type == NODE_FUNCTION_DIV) {
+	if (is_builtin_operator(root)) {
 		print_builtin_math_function(root, env, level);  // Delegate to specific function
 		printf("\n");
 		return;
@@ -663,7 +915,11 @@ bool is_builtin_operator(AST *root){
 	return 	root->type == NODE_FUNCTION_ADD ||
 				root->type == NODE_FUNCTION_SUB ||
 				root->type == NODE_FUNCTION_MUL ||
-				root->type == NODE_FUNCTION_DIV;
+				root->type == NODE_FUNCTION_DIV ||
+				root->type == NODE_FUNCTION_PMAP ||
+				root->type == NODE_FUNCTION_PREDUCE ||
+				root->type == NODE_FUNCTION_PRINT ||
+				root->type == NODE_FUNCTION_FLUSH;
 }
 
 void ast_free(AST *root){
@@ -680,7 +936,15 @@ void ast_free(AST *root){
 	else if(root->type == NODE_FUNCTION){
 		ast_free(root->value.fn.fbody);
 		list_free(root->value.fn.parameters);
+		if(root->value.fn.lazy){
+			ast_free(atomic_load(&root->value.fn.lazy->body));
+			pj_free(root->value.fn.lazy);
+		}
+	}
+	else if(root->type == NODE_NATIVE){
+		pj_free(root->value.native.name);
+		pj_free(root->value.native.types);
 	}
 
-	free(root);
+	pj_free(root);
 }
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include <string.h>
+#include <time.h>
+#include "../includes/chunks.h"
+#include "../includes/stream.h"
+#include "../includes/pool.h"
+#include "../includes/analysis.h"
+#include "../includes/memory.h"
+#include "../includes/trace.h"
+#include "../includes/perf.h"
+#include "../includes/debug.h"
+
+bool parse_parallel = false;
+
+//consecutive top level statements tokenized and parsed by one task
+typedef struct ParseChunk {
+	const char *text;
+	size_t length;
+	int index;
+	List *tokens;
+	int names; //keyword tokens, no chunk numbers more sites than it has names
+	int base; //first site of the chunk
+	AST *root;
+	int sites; //next free site once parsed
+	int functions;
+	bool shadows; //defines a function named like a builtin operator
+	Error error;
+} ParseChunk;
+
+static unsigned long now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long)ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+static void lex_chunk(void *arg){
+	ParseChunk *chunk = (ParseChunk*)arg;
+	trace_begin("tokenize_chunk", chunk->index);
+	//the tokenizer needs a terminated copy
+	char *text = (char*)pj_malloc(MEM_LEXER, chunk->length + 1);
+	memcpy(text, chunk->text, chunk->length);
+	text[chunk->length] = '\0';
+	chunk->tokens = tokenize(text);
+	pj_free(text);
+	for(Node *curr = chunk->tokens->head; curr != NULL; curr = curr->next)
+		if(((Token*)curr->value)->type == TOKEN_KEYWORD) chunk->names++;
+	trace_end("tokenize_chunk");
+}
+
+static void parse_chunk(void *arg){
+	ParseChunk *chunk = (ParseChunk*)arg;
+	trace_begin("parse_chunk", chunk->index);
+	Enviroment *symbols = create_global_env(SYMBOL_SIZE);
+	Parser *parser = parser_init(chunk->tokens);
+	parser->sites = chunk->base;
+	chunk->root = parse_block(parser, symbols, false, &chunk->error);
+	chunk->sites = parser->sites;
+	chunk->functions = parser->functions;
+	chunk->shadows = parser_shadows_builtin(symbols);
+	pj_free(parser);
+	env_free(symbols);
+	trace_end("parse_chunk");
+}
+
+// Run fn on every chunk on the thread pool and wait for all of them
+static void run_chunks(ParseChunk *chunks, int count, PoolTaskFn fn){
+	TaskGroup group;
+	atomic_init(&group.pending, 0);
+	for(int i = 0; i < count; i++) pool_spawn(&group, fn, &chunks[i]);
+	pool_wait(&group);
+}
+
+// Cut source after top level statements into chunks of at least target bytes, the last chunk takes
+// whatever is left. Returns the number of chunks
+static int split_chunks(const char *source, size_t length, size_t target, ParseChunk *chunks, int capacity){
+	StatementSplitter splitter;
+	splitter_init(&splitter);
+	splitter_feed(&splitter, source, length);
+	int count = 0;
+	size_t begin = 0;
+	bool pending = false; //a statement was read since begin
+	const char *statement;
+	size_t size;
+	while(splitter_finish(&splitter, &statement, &size)){
+		size_t end = statement - splitter.buffer + size;
+		pending = true;
+		if(end - begin < target || count == capacity - 1) continue;
+		chunks[count].text = source + begin;
+		chunks[count].length = end - begin;
+		count++;
+		begin = end;
+		pending = false;
+	}
+	splitter_free(&splitter);
+
+	//trailing blanks go to the last chunk instead of making one of their own
+	if(pending || count == 0){
+		chunks[count].text = source + begin;
+		chunks[count].length = length - begin;
+		count++;
+	}
+	else chunks[count - 1].length = length - (chunks[count - 1].text - source);
+	for(int i = 0; i < count; i++){
+		chunks[i].index = i;
+		chunks[i].tokens = NULL;
+		chunks[i].names = 0;
+		chunks[i].root = NULL;
+		chunks[i].error.err = NULL;
+		chunks[i].error.message = NULL;
+		chunks[i].error.type = ERR_NONE;
+	}
+	return count;
+}
+
+static void free_chunks(ParseChunk *chunks, int count){
+	for(int i = 0; i < count; i++){
+		ast_free(chunks[i].root);
+		if(chunks[i].tokens) free_list(chunks[i].tokens, token_free);
+	}
+	pj_free(chunks);
+}
+
+// Tokenize and parse source a chunk of top level statements per task, then join the chunks' statements
+// in source order. Chunks number sites from the count of names before them, so sites never collide.
+// Returns NULL without an error when the source is better parsed in one piece: it is small, the pool
+// has a single thread, or a chunk defines a function named like a builtin operator, which changes how
+// the chunks after it parse
+PjProgram* pj_compile_chunks(const char *source, Error *error, PjCompileStats *stats){
+	error->err = NULL;
+	error->message = NULL;
+	error->type = ERR_NONE;
+	size_t length = strlen(source);
+	int threads = pool_size();
+	size_t target = length / (threads * CHUNKS_PER_THREAD);
+	if(target < CHUNK_MIN_BYTES) target = CHUNK_MIN_BYTES;
+	if(threads == 1 || length < 2 * target) return NULL;
+
+	unsigned long allocations = pj_allocations();
+	unsigned long start = stats ? now_ns() : 0;
+	int capacity = (int)(length / target) + 1;
+	ParseChunk *chunks = (ParseChunk*)pj_malloc(MEM_PARSER, capacity * sizeof(ParseChunk));
+	trace_begin("tokenize", -1);
+	perf_phase_begin(PERF_LEX);
+	int count = split_chunks(source, length, target, chunks, capacity);
+	run_chunks(chunks, count, lex_chunk);
+	perf_phase_end(PERF_LEX);
+	trace_end("tokenize");
+	if(stats){
+		unsigned long end = now_ns();
+		stats->lex.nanoseconds = end - start;
+		stats->lex.allocations = pj_allocations() - allocations;
+		allocations = pj_allocations();
+		start = end;
+	}
+
+	int sites = 0;
+	for(int i = 0; i < count; i++){
+		chunks[i].base = sites;
+		sites += chunks[i].names;
+	}
+	trace_begin("parse_block", -1);
+	perf_phase_begin(PERF_PARSE);
+	run_chunks(chunks, count, parse_chunk);
+	trace_end("parse_block");
+
+	//the first error in source order is reported, unless a chunk before it changed how it parses
+	for(int i = 0; i < count; i++){
+		if(chunks[i].error.type != ERR_NONE){
+			*error = chunks[i].error;
+			break;
+		}
+		if(chunks[i].shadows && i < count - 1){
+			perf_phase_end(PERF_PARSE);
+			free_chunks(chunks, count);
+			return NULL;
+		}
+	}
+	if(error->err != NULL){
+		perf_phase_end(PERF_PARSE);
+		free_chunks(chunks, count);
+		return NULL;
+	}
+
+	//statements move to one block, the chunks' token lists stay with the program
+	PjProgram *program = vm_program_new();
+	program->chunks = createList();
+	List *statements = createList();
+	for(int i = 0; i < count; i++){
+		AST *root = chunks[i].root;
+		if(root){
+			for(Node *curr = root->value.statements->head; curr != NULL; curr = curr->next) list_push(statements, curr->value);
+			list_free(root->value.statements);
+			pj_free(root);
+		}
+		list_push(program->chunks, chunks[i].tokens);
+		program->functions += chunks[i].functions;
+	}
+	program->sites = chunks[count - 1].sites;
+	program->root = make_block_node(statements);
+	pj_free(chunks);
+	DEBUG_LOG(DEBUG_PARSER, DEBUG_INFO, "parsed %d chunks of %zu bytes", count, target);
+
+	trace_begin("analyze_program", -1);
+	analyze_program(program->root);
+	trace_end("analyze_program");
+	perf_phase_end(PERF_PARSE);
+	if(stats){
+		stats->parse.nanoseconds = now_ns() - start;
+		stats->parse.allocations = pj_allocations() - allocations;
+	}
+	return program;
+}
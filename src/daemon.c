@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "../includes/daemon.h"
+#include "../includes/memory.h"
+
+/*===================== Program cache =====================*/
+
+static unsigned long long content_hash(const char *source, size_t length){
+	unsigned long long hash = 14695981039346656037ull;
+	for(size_t i = 0; i < length; i++){
+		hash ^= (unsigned char)source[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static void cache_unlink(ProgramCache *cache, CachedProgram *entry){
+	if(entry->prev) entry->prev->next = entry->next;
+	else cache->head = entry->next;
+	if(entry->next) entry->next->prev = entry->prev;
+	else cache->tail = entry->prev;
+	entry->prev = entry->next = NULL;
+}
+
+static void cache_push_front(ProgramCache *cache, CachedProgram *entry){
+	entry->prev = NULL;
+	entry->next = cache->head;
+	if(cache->head) cache->head->prev = entry;
+	cache->head = entry;
+	if(!cache->tail) cache->tail = entry;
+}
+
+static void cache_entry_free(CachedProgram *entry){
+	pj_program_free(entry->program);
+	pj_free(entry->source);
+	pj_free(entry);
+}
+
+// Cached program for source, moved to the front of the recency order. Called with the lock held
+static CachedProgram* cache_find(ProgramCache *cache, unsigned long long hash, const char *source, size_t length){
+	for(CachedProgram *entry = cache->head; entry != NULL; entry = entry->next){
+		if(entry->hash != hash || entry->length != length || memcmp(entry->source, source, length) != 0) continue;
+		cache_unlink(cache, entry);
+		cache_push_front(cache, entry);
+		entry->refs++;
+		return entry;
+	}
+	return NULL;
+}
+
+// Compiled program for source, compiling it on a miss. NULL and error filled when it does not compile.
+// Programs are compiled outside the lock, two requests missing on the same source keep the first one cached
+CachedProgram* cache_acquire(ProgramCache *cache, const char *source, size_t length, Error *error){
+	unsigned long long hash = content_hash(source, length);
+	pthread_mutex_lock(&cache->lock);
+	CachedProgram *entry = cache_find(cache, hash, source, length);
+	pthread_mutex_unlock(&cache->lock);
+	if(entry) return entry;
+
+	//the tokenizer reads up to a terminator
+	char *copy = (char*)pj_malloc(MEM_IO, length + 1);
+	memcpy(copy, source, length);
+	copy[length] = '\0';
+	PjProgram *program = pj_compile(copy, error);
+	if(program == NULL){
+		pj_free(copy);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&cache->lock);
+	entry = cache_find(cache, hash, source, length);
+	if(entry){
+		pthread_mutex_unlock(&cache->lock);
+		pj_program_free(program);
+		pj_free(copy);
+		return entry;
+	}
+	entry = (CachedProgram*)pj_calloc(MEM_IO, 1, sizeof(CachedProgram));
+	entry->hash = hash;
+	entry->source = copy;
+	entry->length = length;
+	entry->program = program;
+	entry->refs = 2;
+	cache_push_front(cache, entry);
+
+	//evicted programs are freed by the last request still running them
+	CachedProgram *evicted = NULL;
+	if(++cache->count > cache->capacity){
+		evicted = cache->tail;
+		cache_unlink(cache, evicted);
+		cache->count--;
+		if(--evicted->refs > 0) evicted = NULL;
+	}
+	pthread_mutex_unlock(&cache->lock);
+	if(evicted) cache_entry_free(evicted);
+	return entry;
+}
+
+void cache_release(ProgramCache *cache, CachedProgram *entry){
+	pthread_mutex_lock(&cache->lock);
+	bool last = --entry->refs == 0;
+	pthread_mutex_unlock(&cache->lock);
+	if(last) cache_entry_free(entry);
+}
+
+/*===================== Daemon =====================*/
+
+typedef struct Daemon {
+	ProgramCache cache;
+	int queue[DAEMON_BACKLOG]; //accepted connections
+	int head;
+	int count;
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	pthread_cond_t space;
+} Daemon;
+
+// Read the file at path, NULL with problem set when it cannot be read or is too large to serve
+static char* read_file(const char *path, size_t *length, const char **problem){
+	FILE *f = fopen(path, "rb");
+	if(f == NULL){
+		*problem = "cannot open the script";
+		return NULL;
+	}
+	struct stat st;
+	long size = fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode) && fseek(f, 0, SEEK_END) == 0 ? ftell(f) : -1;
+	if(size < 0 || fseek(f, 0, SEEK_SET) != 0 || size > DAEMON_SOURCE_MAX){
+		*problem = size > DAEMON_SOURCE_MAX ? "script is larger than the source limit" : "cannot read the script";
+		fclose(f);
+		return NULL;
+	}
+	char *source = (char*)pj_malloc(MEM_IO, size > 0 ? size : 1);
+	*length = fread(source, 1, size, f);
+	fclose(f);
+	return source;
+}
+
+//results go through the instance's buffer, after anything the statement printed
+static void emit_result(RuntimeVal result, void *ctx){
+	PjVM *vm = (PjVM*)ctx;
+	output_runtime_val(&vm->out, result);
+	output_flush(&vm->out);
+}
+
+// Serve a single request, each one runs on a fresh instance so requests never see each other's globals
+static void serve(Daemon *daemon, int fd){
+	FILE *in = fdopen(fd, "r");
+	FILE *out = fdopen(dup(fd), "w");
+	if(in == NULL || out == NULL){
+		if(in) fclose(in); else close(fd);
+		if(out) fclose(out);
+		return;
+	}
+
+	char line[4096];
+	char *source = NULL;
+	size_t length = 0;
+	const char *problem = "request expected `run <path>` or `eval <length>`";
+	if(fgets(line, sizeof(line), in) != NULL){
+		line[strcspn(line, "\r\n")] = '\0';
+		if(strncmp(line, "run ", 4) == 0) source = read_file(line + 4, &length, &problem);
+		else if(strncmp(line, "eval ", 5) == 0){
+			//the length comes from the client, it is checked before anything is allocated
+			char *end;
+			errno = 0;
+			long long requested = strtoll(line + 5, &end, 10);
+			if(end == line + 5 || *end != '\0' || errno == ERANGE || requested < 0) problem = "eval length must be a number of bytes";
+			else if(requested > DAEMON_SOURCE_MAX) problem = "eval length is larger than the source limit";
+			else {
+				length = (size_t)requested;
+				source = (char*)pj_malloc(MEM_IO, length > 0 ? length : 1);
+				length = fread(source, 1, length, in);
+			}
+		}
+	}
+
+	if(source == NULL) fprintf(out, "error %s\n", problem);
+	else {
+		Error error;
+		CachedProgram *entry = cache_acquire(&daemon->cache, source, length, &error);
+		if(entry == NULL) fprintf(out, "error %s [%u] %s\n", error.err, error.type, error.message);
+		else {
+			PjVM *vm = pj_vm_new();
+			vm->out.fd = fileno(out);
+			pj_vm_eval_each(vm, entry->program, emit_result, vm);
+			pj_vm_free(vm);
+			cache_release(&daemon->cache, entry);
+		}
+		pj_free(source);
+	}
+	fprintf(out, "end\n");
+	fclose(out);
+	fclose(in);
+}
+
+static void* daemon_worker(void *arg){
+	Daemon *daemon = (Daemon*)arg;
+	while(true){
+		pthread_mutex_lock(&daemon->lock);
+		while(daemon->count == 0) pthread_cond_wait(&daemon->ready, &daemon->lock);
+		int fd = daemon->queue[daemon->head];
+		daemon->head = (daemon->head + 1) % DAEMON_BACKLOG;
+		daemon->count--;
+		pthread_cond_signal(&daemon->space);
+		pthread_mutex_unlock(&daemon->lock);
+		serve(daemon, fd);
+	}
+	return NULL;
+}
+
+// Listen on a unix domain socket and evaluate requests until the process is stopped
+int pj_daemon_run(const char *socket_path, int workers){
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(strlen(socket_path) >= sizeof(addr.sun_path)){
+		fprintf(stderr, "daemon: socket path too long\n");
+		return 1;
+	}
+	strcpy(addr.sun_path, socket_path);
+
+	//a socket left by a previous daemon is replaced, anything else at the path is not
+	struct stat st;
+	if(stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(socket_path);
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(listener < 0 || bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, DAEMON_BACKLOG) < 0){
+		perror("daemon");
+		if(listener >= 0) close(listener);
+		return 1;
+	}
+	//clients hanging up early must not take the daemon down
+	signal(SIGPIPE, SIG_IGN);
+
+	static Daemon daemon;
+	daemon.cache.head = daemon.cache.tail = NULL;
+	daemon.cache.count = 0;
+	daemon.cache.capacity = DAEMON_CACHE_SIZE;
+	pthread_mutex_init(&daemon.cache.lock, NULL);
+	daemon.head = daemon.count = 0;
+	pthread_mutex_init(&daemon.lock, NULL);
+	pthread_cond_init(&daemon.ready, NULL);
+	pthread_cond_init(&daemon.space, NULL);
+
+	if(workers < 1) workers = DAEMON_WORKERS;
+	for(int i = 0; i < workers; i++){
+		pthread_t thread;
+		pthread_create(&thread, NULL, daemon_worker, &daemon);
+		pthread_detach(thread);
+	}
+
+	while(true){
+		int fd = accept(listener, NULL, NULL);
+		if(fd < 0) continue;
+		pthread_mutex_lock(&daemon.lock);
+		while(daemon.count == DAEMON_BACKLOG) pthread_cond_wait(&daemon.space, &daemon.lock);
+		daemon.queue[(daemon.head + daemon.count) % DAEMON_BACKLOG] = fd;
+		daemon.count++;
+		pthread_cond_signal(&daemon.ready);
+		pthread_mutex_unlock(&daemon.lock);
+	}
+	return 0;
+}
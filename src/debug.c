@@ -0,0 +1,90 @@
+#include "../includes/debug.h"
+#ifdef PJ_DEBUG
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <time.h>
+
+DebugLevel debug_levels[DEBUG_CATEGORIES];
+
+static const char *category_names[DEBUG_CATEGORIES] = { "lexer", "parser", "eval", "env" };
+
+//writers claim a ticket and own the entry it maps to, seq is 0 while the entry is being written
+//and ticket + 1 once it holds that ticket's message, so a reader can tell torn entries apart
+typedef struct DebugEntry {
+	atomic_ulong seq;
+	DebugCategory category;
+	DebugLevel level;
+	unsigned long ns;
+	char text[DEBUG_TEXT];
+} DebugEntry;
+
+static DebugEntry ring[DEBUG_RING];
+static atomic_ulong next_ticket;
+
+static unsigned long now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long)ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+// Record a message, called through DEBUG_LOG once the category's level was checked
+void debug_log(DebugCategory category, DebugLevel level, const char *format, ...){
+	unsigned long ticket = atomic_fetch_add_explicit(&next_ticket, 1, memory_order_relaxed);
+	DebugEntry *entry = &ring[ticket % DEBUG_RING];
+	atomic_store_explicit(&entry->seq, 0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	entry->category = category;
+	entry->level = level;
+	entry->ns = now_ns();
+	va_list args;
+	va_start(args, format);
+	vsnprintf(entry->text, DEBUG_TEXT, format, args);
+	va_end(args);
+	atomic_store_explicit(&entry->seq, ticket + 1, memory_order_release);
+}
+
+// Switch categories on from a spec like `eval,env:2` or `all`, a category without a level logs info messages
+bool debug_configure(const char *spec){
+	while(*spec){
+		size_t length = strcspn(spec, ",:");
+		DebugLevel level = DEBUG_INFO;
+		const char *next = spec + length;
+		if(*next == ':'){
+			level = (DebugLevel)strtol(next + 1, (char**)&next, 10);
+			if(level > DEBUG_VERBOSE) level = DEBUG_VERBOSE;
+		}
+		bool found = false;
+		for(int category = 0; category < DEBUG_CATEGORIES; category++){
+			bool all = length == 3 && strncmp(spec, "all", 3) == 0;
+			if(!all && (strlen(category_names[category]) != length || strncmp(spec, category_names[category], length) != 0)) continue;
+			debug_levels[category] = level;
+			found = true;
+		}
+		if(!found){
+			fprintf(stderr, "debug: unknown category `%.*s`, expected lexer, parser, eval, env or all\n", (int)length, spec);
+			return false;
+		}
+		spec = *next == ',' ? next + 1 : next;
+	}
+	return true;
+}
+
+// Write the messages still in the ring, oldest first, skipping entries a writer is still filling
+void debug_dump(FILE *out){
+	unsigned long end = atomic_load(&next_ticket);
+	unsigned long start = end > DEBUG_RING ? end - DEBUG_RING : 0;
+	if(start > 0) fprintf(out, "debug: %lu older messages were overwritten\n", start);
+	for(unsigned long ticket = start; ticket < end; ticket++){
+		DebugEntry *entry = &ring[ticket % DEBUG_RING], copy;
+		unsigned long seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+		if(seq != ticket + 1) continue;
+		memcpy(&copy, entry, sizeof(DebugEntry));
+		atomic_thread_fence(memory_order_acquire);
+		if(atomic_load_explicit(&entry->seq, memory_order_relaxed) != seq) continue;
+		fprintf(out, "%lu.%06lu %-6s %s %s\n", copy.ns / 1000000000ul, copy.ns / 1000 % 1000000,
+			category_names[copy.category], copy.level == DEBUG_INFO ? "info" : "verbose", copy.text);
+	}
+}
+#endif
@@ -1,35 +1,82 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "../includes/enviroment.h"
 #include "../includes/ast.h"
+#include "../includes/vm.h"
+#include "../includes/memory.h"
+#include "../includes/stats.h"
+#include "../includes/debug.h"
+
+//next version of a scope, versions handed out by an interpreter instance are unique within it
+static unsigned long env_next_version(Enviroment *env){
+	return env->vm ? ++env->vm->clock : env->version + 1;
+}
 
 //initialize enviroment
 Enviroment* env_init(int env_size){
-	Enviroment *env = (Enviroment*)malloc(sizeof(Enviroment));
-	env->variables = create_htable(env_size);
-	env->fn_defs = create_htable(env_size);
+	Enviroment *env = (Enviroment*)pj_malloc(MEM_ENV, sizeof(Enviroment));
+	env->names = scope_init(env_size);
 	env->parent = NULL;
+	env->vm = NULL;
+	env->version = 0;
+	return env;
+}
+
+//create a scope nested in parent and owned by the interpreter instance evaluating it,
+//scopes freed by the instance earlier are reused
+Enviroment* env_new_scope(Enviroment *parent, struct PjVM *vm, int env_size){
+	Enviroment *env = vm ? vm->spare_scopes : NULL;
+	if(env){
+		vm->spare_scopes = env->parent;
+		scope_clear(env->names, env_size);
+	}
+	else env = env_init(env_size);
+	env->parent = parent;
+	env->vm = vm;
+	env->version = env_next_version(env);
 	return env;
 }
 
-//create the global env with builtin variables and functions
+//create the global env with builtin variables and functions,
+//its names are copied so globals stay defined after the program that assigned them is freed
 Enviroment*	create_global_env(int env_size){
 	Enviroment *env = env_init(env_size);
+	env->names->owns_names = true;
 	env_assign_var(env, "true", make_bool_node(true));
 	env_assign_var(env, "false", make_bool_node(false));
 	env_assign_var(env, "null", make_int_node(0));
 	return env;
 }
 
-//define a variable in an enviroment
+//free the enviroment with its variable values, function definitions belong to the program.
+//Scopes of an instance go back to it for later calls
+void env_free(Enviroment *env){
+	if(env == NULL) return;
+	Scope *names = env->names;
+	int slots = names->hashed ? names->capacity : names->count;
+	for(int i = 0; i < slots; i++)
+		if(names->entries[i].dist != 0) vm_release_node(env->vm, names->entries[i].var);
+	if(env->vm){
+		env->parent = env->vm->spare_scopes;
+		env->vm->spare_scopes = env;
+		return;
+	}
+	scope_free(env->names);
+	pj_free(env);
+}
+
+//define a variable in an enviroment, an existing variable is updated in place
 void*	env_assign_var(Enviroment *env, char *vname, void* value){
 	if(env == NULL || value == NULL) return NULL;
 
-	if(ht_retrieve(env->variables, vname))
-		ht_delete(&env->variables, vname);
-	
-	ht_add(&env->variables, vname, value);
-	return ht_retrieve(env->variables, value);
+	bool created;
+	ScopeEntry *entry = scope_insert(env->names, vname, &created);
+	DEBUG_LOG(DEBUG_ENV, DEBUG_VERBOSE, "%s variable `%s`", created || entry->var == NULL ? "define" : "update", vname);
+	if(created || entry->var == NULL) env->version = env_next_version(env);
+	else if(entry->var != value) vm_release_node(env->vm, entry->var);
+	entry->var = value;
+	return entry->var;
 }
 
 //get variable from the enviroment
@@ -38,22 +85,23 @@ void*	env_get_var(Enviroment *env, char *vname){
 
 	Enviroment *curr = env;
 	while(curr != NULL){
-		void *value = ht_retrieve(curr->variables, vname);
-		if(value) return value;
+		ScopeEntry *entry = scope_find(curr->names, vname);
+		if(entry && entry->var) return entry->var;
 		curr = curr->parent;
 	}
 	return NULL;
 }
 
-//define a function in the enviroment
+//define a function in the enviroment, an existing definition is replaced in place
 void*	env_define_func(Enviroment *env, char *fname, void* fbody){
 	if(env == NULL || fbody == NULL) return NULL;
 
-	if(ht_retrieve(env->fn_defs, fname))
-		ht_delete(&env->fn_defs, fname);
-	
-	ht_add(&env->fn_defs, fname, fbody);
-	return ht_retrieve(env->fn_defs, fname);
+	bool created;
+	ScopeEntry *entry = scope_insert(env->names, fname, &created);
+	DEBUG_LOG(DEBUG_ENV, DEBUG_VERBOSE, "%s function `%s`", created || entry->fn == NULL ? "define" : "replace", fname);
+	if(created || entry->fn == NULL) env->version = env_next_version(env);
+	entry->fn = fbody;
+	return entry->fn;
 }
 
 //get function from the enviroment
@@ -62,8 +110,8 @@ void* env_get_function(Enviroment *env, char *fname){
 
 	Enviroment *curr = env;
 	while(curr != NULL){
-		void* value = ht_retrieve(curr->fn_defs, fname);
-		if(value) return value;
+		ScopeEntry *entry = scope_find(curr->names, fname);
+		if(entry && entry->fn) return entry->fn;
 		curr = curr->parent;
 	}
 	return NULL;
@@ -71,9 +119,73 @@ void* env_get_function(Enviroment *env, char *fname){
 
 Enviroment*	env_get(Enviroment *env, char *fname){
 	if(env == NULL) return NULL;
-	void* fn = ht_retrieve(env->fn_defs, fname);
-	if(fn != NULL) return env;
-	void* var = ht_retrieve(env->variables, fname);
-	if(var != NULL) return env;
+	ScopeEntry *entry = scope_find(env->names, fname);
+	if(entry != NULL && (entry->fn != NULL || entry->var != NULL)) return env;
 	return env_get(env->parent, fname);
+}
+
+//entry of scope holding name as a variable or function, NULL when it holds neither
+static ScopeEntry* env_holds(Enviroment *env, char *name, unsigned int hash, bool fn){
+	ScopeEntry *entry = scope_find_hashed(env->names, name, hash);
+	return entry && (fn ? entry->fn : entry->var) ? entry : NULL;
+}
+
+//entry at the cached index of env, when it still holds the cached name
+static ScopeEntry* env_cached_entry(Enviroment *env, char *name, bool fn, InlineCache *cache){
+	if(env == cache->owner && env->version == cache->version && (fn ? cache->slot->fn : cache->slot->var)) return cache->slot;
+	Scope *names = env->names;
+	if(cache->index >= (names->hashed ? names->capacity : names->count)) return NULL;
+	ScopeEntry *entry = &names->entries[cache->index];
+	if(entry->dist == 0 || entry->hash != cache->hash || (fn ? entry->fn : entry->var) == NULL) return NULL;
+	if(entry->name != name && strcmp(entry->name, name) != 0) return NULL;
+	return entry;
+}
+
+//resolve a variable or function entry, reusing the site's cache while no scope below the cached one defines the name.
+//A hit still probes the scopes below the cached one: they are mostly call scopes made since the cache was
+//filled, which an assignment in the body can give the name, and no version vouches for a scope not seen before
+ScopeEntry* env_lookup(Enviroment *env, char *name, bool fn, InlineCache *cache, Enviroment **owner){
+	if(env == NULL) return NULL;
+
+	if(cache && cache->depth > 0 && cache->name == name && cache->fn == fn){
+		Enviroment *curr = env;
+		int depth = 0;
+		while(curr && depth < cache->depth - 1 && !env_holds(curr, name, cache->hash, fn)){
+			curr = curr->parent;
+			depth++;
+		}
+		ScopeEntry *entry = curr && depth == cache->depth - 1 ? env_cached_entry(curr, name, fn, cache) : NULL;
+		if(entry){
+			cache->owner = curr;
+			cache->version = curr->version;
+			cache->slot = entry;
+			STATS_LOOKUP(depth, true);
+			if(owner) *owner = curr;
+			return entry;
+		}
+	}
+
+	unsigned int hash = scope_hash(name);
+	int depth = 0;
+	for(Enviroment *curr = env; curr != NULL; curr = curr->parent, depth++){
+		ScopeEntry *entry = env_holds(curr, name, hash, fn);
+		if(entry == NULL) continue;
+
+		if(cache && depth < IC_MAX_DEPTH){
+			cache->owner = curr;
+			cache->version = curr->version;
+			cache->slot = entry;
+			cache->index = (int)(entry - curr->names->entries);
+			cache->hash = hash;
+			cache->name = name;
+			cache->fn = fn;
+			cache->depth = depth + 1;
+		}
+		STATS_LOOKUP(depth, false);
+		if(owner) *owner = curr;
+		return entry;
+	}
+	STATS_LOOKUP(-1, false);
+	DEBUG_LOG(DEBUG_ENV, DEBUG_INFO, "`%s` is not defined", name);
+	return NULL;
 }
\ No newline at end of file
@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../includes/image.h"
+#include "../includes/scope.h"
+#include "../includes/memory.h"
+#include "../includes/trace.h"
+#include "../includes/analysis.h"
+
+/*===================== Writing =====================*/
+
+typedef struct ImageWriter {
+	ImageNode *nodes;
+	uint32_t node_count, node_capacity;
+	uint32_t *words;
+	uint32_t word_count, word_capacity;
+	char *strings;
+	uint32_t string_size, string_capacity;
+	Scope *interned; //string to its offset + 1, every name is stored once
+	bool failed; //the program holds nodes an image cannot represent
+} ImageWriter;
+
+static void* grow(void *data, uint32_t *capacity, uint32_t needed, size_t item){
+	if(needed <= *capacity) return data;
+	while(*capacity < needed) *capacity = *capacity > 0 ? *capacity * 2 : 64;
+	return pj_realloc(MEM_IO, data, *capacity * item);
+}
+
+// FNV-1a of the source, images compiled from other contents are ignored
+uint64_t pj_image_hash(const char *source, size_t length){
+	uint64_t hash = 14695981039346656037ull;
+	for(size_t i = 0; i < length; i++){
+		hash ^= (unsigned char)source[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static uint32_t write_string(ImageWriter *writer, char *string){
+	if(string == NULL) return 0;
+	bool created;
+	ScopeEntry *entry = scope_insert(writer->interned, string, &created);
+	if(!created) return (uint32_t)(uintptr_t)entry->var;
+	uint32_t length = strlen(string) + 1;
+	writer->strings = grow(writer->strings, &writer->string_capacity, writer->string_size + length, 1);
+	memcpy(writer->strings + writer->string_size, string, length);
+	entry->var = (void*)(uintptr_t)(writer->string_size + 1);
+	writer->string_size += length;
+	return (uint32_t)(uintptr_t)entry->var;
+}
+
+static uint32_t write_node(ImageWriter *writer, AST *node);
+
+// Write the items of a list of nodes, or of strings for parameters, then the list itself
+static uint32_t write_list(ImageWriter *writer, List *list, bool strings){
+	if(list == NULL) return 0;
+	uint32_t *items = (uint32_t*)pj_malloc(MEM_IO, (list->size > 0 ? list->size : 1) * sizeof(uint32_t));
+	uint32_t count = 0;
+	for(Node *curr = list->head; curr != NULL; curr = curr->next)
+		items[count++] = strings ? write_string(writer, curr->value) : write_node(writer, curr->value);
+
+	writer->words = grow(writer->words, &writer->word_capacity, writer->word_count + count + 1, sizeof(uint32_t));
+	uint32_t offset = writer->word_count;
+	writer->words[writer->word_count++] = count;
+	memcpy(writer->words + writer->word_count, items, count * sizeof(uint32_t));
+	writer->word_count += count;
+	pj_free(items);
+	return offset + 1;
+}
+
+// Write a node after everything it refers to, returns its index + 1
+static uint32_t write_node(ImageWriter *writer, AST *node){
+	if(node == NULL || writer->failed) return 0;
+	ImageNode out;
+	memset(&out, 0, sizeof(ImageNode));
+	out.type = node->type;
+	out.cost = node->cost;
+	out.pure = node->pure;
+	out.site = -1;
+	out.left = write_node(writer, node->left);
+	out.right = write_node(writer, node->right);
+
+	if(is_builtin_operator(node)) out.a = write_list(writer, node->value.arguments, false);
+	else switch(node->type){
+		case NODE_INT:
+		case NODE_FLOAT: {
+			//ints and doubles are both 64 bits, a takes the low half and b the high half
+			uint64_t bits;
+			memcpy(&bits, &node->value.i_value, sizeof(uint64_t));
+			out.a = (uint32_t)bits;
+			out.b = (uint32_t)(bits >> 32);
+			break;
+		}
+		case NODE_BOOL:	out.a = node->value.b_value; break;
+		case NODE_BLOCK:	out.a = write_list(writer, node->value.statements, false); break;
+		case NODE_IF_ELSE:	out.a = write_node(writer, node->value.condition); break;
+		case NODE_RETURN:	out.a = write_node(writer, node->value.return_expr); break;
+		case NODE_VARIABLE:
+			out.a = write_string(writer, node->value.var.vname);
+			out.site = node->value.var.site;
+			break;
+		case NODE_ASSIGN:
+			out.a = write_string(writer, node->value.var.vname);
+			out.b = write_node(writer, node->value.var.expr);
+			out.site = node->value.var.site;
+			break;
+		case NODE_CALL:
+			out.a = write_string(writer, node->value.call_expr.caller);
+			out.b = write_list(writer, node->value.call_expr.arguments, false);
+			out.site = node->value.call_expr.site;
+			break;
+		case NODE_FUNCTION: {
+			//images hold every body parsed, lazy ones are parsed now
+			AST *body = node->value.fn.fbody;
+			Error error;
+			if(body == NULL && node->value.fn.lazy && (body = parse_function_body(node, &error)) == NULL){
+				writer->failed = true;
+				return 0;
+			}
+			out.a = write_string(writer, node->value.fn.fname);
+			out.b = write_node(writer, body);
+			out.c = write_list(writer, node->value.fn.parameters, true);
+			break;
+		}
+		//objects, natives and values made at runtime have no image form
+		case NODE_OBJECT: case NODE_NATIVE: case NODE_SLICE: case NODE_FUNC_VARIABLE:
+			writer->failed = true;
+			return 0;
+		default: break;
+	}
+	if(writer->failed) return 0;
+
+	writer->nodes = grow(writer->nodes, &writer->node_capacity, writer->node_count + 1, sizeof(ImageNode));
+	writer->nodes[writer->node_count++] = out;
+	return writer->node_count;
+}
+
+// Save program as the image of a source with the given hash
+bool pj_image_write(const PjProgram *program, uint64_t hash, const char *path){
+	return image_save(IMAGE_MAGIC, program->root, program->sites, program->functions, hash, path);
+}
+
+// Write the tree under root to path, sites and functions are those of the program it belongs to.
+// The file is written to a temporary name and renamed, so a process mapping path never sees it half written
+bool image_save(const char *magic, AST *root, int sites, int functions, uint64_t hash, const char *path){
+	ImageWriter writer;
+	memset(&writer, 0, sizeof(ImageWriter));
+	writer.interned = scope_init(64);
+
+	ImageHeader header;
+	memset(&header, 0, sizeof(ImageHeader));
+	strncpy(header.magic, magic, sizeof(header.magic));
+	header.version = IMAGE_VERSION;
+	header.node_types = NODE_TYPES;
+	header.hash = hash;
+	header.root = write_node(&writer, root);
+	header.nodes = writer.node_count;
+	header.words = writer.word_count;
+	header.strings = writer.string_size;
+	header.sites = sites;
+	header.functions = functions;
+
+	bool written = false;
+	if(!writer.failed){
+		size_t length = strlen(path);
+		char *temporary = (char*)pj_malloc(MEM_IO, length + 32);
+		snprintf(temporary, length + 32, "%s.%ld.tmp", path, (long)getpid());
+		FILE *out = fopen(temporary, "wb");
+		if(out){
+			written = fwrite(&header, sizeof(ImageHeader), 1, out) == 1
+				&& fwrite(writer.nodes, sizeof(ImageNode), writer.node_count, out) == writer.node_count
+				&& fwrite(writer.words, sizeof(uint32_t), writer.word_count, out) == writer.word_count
+				&& fwrite(writer.strings, 1, writer.string_size, out) == writer.string_size;
+			written = fclose(out) == 0 && written;
+			written = written && rename(temporary, path) == 0;
+			if(!written) unlink(temporary);
+		}
+		pj_free(temporary);
+	}
+
+	pj_free(writer.nodes);
+	pj_free(writer.words);
+	pj_free(writer.strings);
+	scope_free(writer.interned);
+	return written;
+}
+
+/*===================== Loading =====================*/
+
+//a mapped image, only references checked against its bounds are followed
+typedef struct ImageReader {
+	const ImageHeader *header;
+	const ImageNode *nodes;
+	const uint32_t *words;
+	const char *strings;
+	AST **built; //node of every record read so far
+	uint32_t *owner; //index + 1 of the record each node was claimed by, a node has one parent
+} ImageReader;
+
+// Claim an earlier record as a child of record index
+static bool claim_child(ImageReader *reader, uint32_t ref, uint32_t index){
+	if(ref == 0) return true;
+	if(ref > index || reader->owner[ref - 1] != 0) return false;
+	reader->owner[ref - 1] = index + 1;
+	return true;
+}
+
+//names and lists are never NULL in a parsed program
+static bool valid_name(ImageReader *reader, uint32_t ref){
+	return ref != 0 && ref <= reader->header->strings;
+}
+
+static bool claim_list(ImageReader *reader, uint32_t ref, uint32_t index, bool strings){
+	if(ref == 0 || ref > reader->header->words) return false;
+	uint32_t count = reader->words[ref - 1];
+	if(count > reader->header->words - ref) return false;
+	for(uint32_t i = 0; i < count; i++){
+		uint32_t item = reader->words[ref + i];
+		if(strings ? !valid_name(reader, item) : !claim_child(reader, item, index)) return false;
+	}
+	return true;
+}
+
+// Check and claim every reference of record index before building it, so a damaged image never builds half a node
+static bool claim_node(ImageReader *reader, const ImageNode *record, uint32_t index){
+	AST probe;
+	probe.type = record->type;
+	if(record->type >= NODE_TYPES) return false;
+	if(record->site < -1 || record->site >= reader->header->sites) return false;
+	if(!claim_child(reader, record->left, index) || !claim_child(reader, record->right, index)) return false;
+	if(is_builtin_operator(&probe)) return claim_list(reader, record->a, index, false);
+	switch(record->type){
+		case NODE_BLOCK:	return claim_list(reader, record->a, index, false);
+		case NODE_IF_ELSE:	return claim_child(reader, record->a, index);
+		case NODE_RETURN:	return claim_child(reader, record->a, index);
+		case NODE_VARIABLE:	return valid_name(reader, record->a);
+		case NODE_ASSIGN:	return valid_name(reader, record->a) && claim_child(reader, record->b, index);
+		case NODE_CALL:		return valid_name(reader, record->a) && claim_list(reader, record->b, index, false);
+		case NODE_FUNCTION:
+			return valid_name(reader, record->a) && claim_child(reader, record->b, index)
+				&& claim_list(reader, record->c, index, true);
+		case NODE_OBJECT: case NODE_NATIVE: case NODE_SLICE: case NODE_FUNC_VARIABLE: return false;
+		default: return true;
+	}
+}
+
+static char* image_string(ImageReader *reader, uint32_t ref){
+	return ref == 0 ? NULL : (char*)reader->strings + ref - 1;
+}
+
+static AST* image_child(ImageReader *reader, uint32_t ref){
+	return ref == 0 ? NULL : reader->built[ref - 1];
+}
+
+static List* image_list(ImageReader *reader, uint32_t ref, bool strings){
+	if(ref == 0) return NULL;
+	List *list = createList();
+	uint32_t count = reader->words[ref - 1];
+	for(uint32_t i = 0; i < count; i++){
+		uint32_t item = reader->words[ref + i];
+		list_push(list, strings ? (void*)image_string(reader, item) : (void*)image_child(reader, item));
+	}
+	return list;
+}
+
+static AST* build_node(ImageReader *reader, const ImageNode *record){
+	AST *node = ast_init(record->type, image_child(reader, record->left), image_child(reader, record->right));
+	node->cost = record->cost;
+	node->pure = record->pure != 0;
+	if(is_builtin_operator(node)){
+		node->value.arguments = image_list(reader, record->a, false);
+		return node;
+	}
+	switch(record->type){
+		case NODE_INT:
+		case NODE_FLOAT: {
+			uint64_t bits = (uint64_t)record->b << 32 | record->a;
+			memcpy(&node->value.i_value, &bits, sizeof(uint64_t));
+			break;
+		}
+		case NODE_BOOL:	node->value.b_value = record->a != 0; break;
+		case NODE_BLOCK:	node->value.statements = image_list(reader, record->a, false); break;
+		case NODE_IF_ELSE:	node->value.condition = image_child(reader, record->a); break;
+		case NODE_RETURN:	node->value.return_expr = image_child(reader, record->a); break;
+		case NODE_VARIABLE:
+			node->value.var.vname = image_string(reader, record->a);
+			node->value.var.site = record->site;
+			break;
+		case NODE_ASSIGN:
+			node->value.var.vname = image_string(reader, record->a);
+			node->value.var.expr = image_child(reader, record->b);
+			node->value.var.site = record->site;
+			break;
+		case NODE_CALL:
+			node->value.call_expr.caller = image_string(reader, record->a);
+			node->value.call_expr.arguments = image_list(reader, record->b, false);
+			node->value.call_expr.site = record->site;
+			break;
+		case NODE_FUNCTION:
+			node->value.fn.fname = image_string(reader, record->a);
+			node->value.fn.fbody = image_child(reader, record->b);
+			node->value.fn.parameters = image_list(reader, record->c, true);
+			node->value.fn.lazy = NULL;
+			break;
+		default: break;
+	}
+	return node;
+}
+
+// Map the image at path and rebuild its program. NULL when there is no image for a source with this hash
+PjProgram* pj_image_load(const char *path, uint64_t hash){
+	//the image may come from a run that did not analyze, it is analyzed again for this one
+	PjProgram *program = image_map(path, IMAGE_MAGIC, hash);
+	if(program) analyze_program(program->root);
+	return program;
+}
+
+// Map a file written by image_save with the same magic and hash and rebuild its tree. Names stay
+// in the mapped string table, which lives as long as the program. NULL for missing or damaged files
+PjProgram* image_map(const char *path, const char *magic, uint64_t hash){
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) return NULL;
+	struct stat st;
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ImageHeader)){
+		close(fd);
+		return NULL;
+	}
+	size_t size = st.st_size;
+	void *image = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(image == MAP_FAILED) return NULL;
+
+	const ImageHeader *header = image;
+	size_t expected = sizeof(ImageHeader) + (size_t)header->nodes * sizeof(ImageNode)
+		+ (size_t)header->words * sizeof(uint32_t) + header->strings;
+	if(strncmp(header->magic, magic, sizeof(header->magic)) != 0 || header->version != IMAGE_VERSION
+		|| header->node_types != NODE_TYPES || header->hash != hash || expected != size
+		|| header->root > header->nodes || header->sites < 0 || header->functions < 0){
+		munmap(image, size);
+		return NULL;
+	}
+
+	ImageReader reader;
+	reader.header = header;
+	reader.nodes = (const ImageNode*)(header + 1);
+	reader.words = (const uint32_t*)(reader.nodes + header->nodes);
+	reader.strings = (const char*)(reader.words + header->words);
+	reader.built = (AST**)pj_calloc(MEM_PARSER, header->nodes > 0 ? header->nodes : 1, sizeof(AST*));
+	reader.owner = (uint32_t*)pj_calloc(MEM_PARSER, header->nodes > 0 ? header->nodes : 1, sizeof(uint32_t));
+
+	//the string table ends with a NUL, so every string offset inside it is terminated
+	bool valid = header->strings == 0 || reader.strings[header->strings - 1] == '\0';
+	uint32_t count = 0;
+	for(; valid && count < header->nodes; count++){
+		if(!claim_node(&reader, &reader.nodes[count], count)){
+			//children claimed before the damage was found go back to being roots, so they are freed
+			for(uint32_t i = 0; i < count; i++) if(reader.owner[i] == count + 1) reader.owner[i] = 0;
+			valid = false;
+			break;
+		}
+		reader.built[count] = build_node(&reader, &reader.nodes[count]);
+	}
+
+	//every node but the root belongs to a parent
+	for(uint32_t i = 0; valid && i < count; i++)
+		if((reader.owner[i] == 0) != (i + 1 == header->root)) valid = false;
+	AST *root = valid && header->root > 0 ? reader.built[header->root - 1] : NULL;
+	if(!valid)
+		for(uint32_t i = 0; i < count; i++) if(reader.owner[i] == 0) ast_free(reader.built[i]);
+	pj_free(reader.built);
+	pj_free(reader.owner);
+	if(!valid){
+		munmap(image, size);
+		return NULL;
+	}
+
+	PjProgram *program = vm_program_new();
+	program->root = root;
+	program->sites = header->sites;
+	program->functions = header->functions;
+	program->image = image;
+	program->image_size = size;
+	return program;
+}
+
+// Compile source read from source_path, reusing the image next to it when it was compiled
+// from the same contents and saving a new one otherwise. Programs with syntax errors get no image
+PjProgram* pj_image_compile(const char *source, const char *source_path, Error *error){
+	error->err = NULL;
+	error->message = NULL;
+	error->type = ERR_NONE;
+	size_t length = strlen(source_path);
+	char *path = (char*)pj_malloc(MEM_IO, length + sizeof(IMAGE_SUFFIX));
+	memcpy(path, source_path, length);
+	memcpy(path + length, IMAGE_SUFFIX, sizeof(IMAGE_SUFFIX));
+
+	uint64_t hash = pj_image_hash(source, strlen(source));
+	trace_begin("load_image", -1);
+	PjProgram *program = pj_image_load(path, hash);
+	trace_end("load_image");
+	if(program == NULL){
+		program = pj_compile(source, error);
+		//a directory that is not writable only costs the next run a compile
+		if(program) pj_image_write(program, hash, path);
+	}
+	pj_free(path);
+	return program;
+}
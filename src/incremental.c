@@ -0,0 +1,194 @@
+#include <string.h>
+#include "../includes/incremental.h"
+#include "../includes/stream.h"
+#include "../includes/scope.h"
+#include "../includes/analysis.h"
+#include "../includes/memory.h"
+#include "../includes/trace.h"
+#include "../includes/perf.h"
+#include "../includes/debug.h"
+
+/*===================== INCREMENTAL =====================*/
+
+PjIncremental* pj_incremental_new(void){
+	PjIncremental *inc = (PjIncremental*)pj_malloc(MEM_PARSER, sizeof(PjIncremental));
+	inc->statements = NULL;
+	inc->count = 0;
+	inc->capacity = 0;
+	inc->sites = 0;
+	inc->live_sites = 0;
+	inc->program = NULL;
+	inc->whole = false;
+	inc->parsed = 0;
+	return inc;
+}
+
+static void statement_free(ParsedStatement *statement){
+	pj_free(statement->text);
+	ast_free(statement->block);
+	if(statement->tokens) free_list(statement->tokens, token_free);
+	pj_free(statement);
+}
+
+static void keep_statement(PjIncremental *inc, ParsedStatement *statement){
+	if(inc->count == inc->capacity){
+		inc->capacity = inc->capacity ? inc->capacity * 2 : 64;
+		inc->statements = (ParsedStatement**)pj_realloc(MEM_PARSER, inc->statements, inc->capacity * sizeof(ParsedStatement*));
+	}
+	inc->statements[inc->count++] = statement;
+	inc->live_sites += statement->sites;
+}
+
+static void drop_statements(PjIncremental *inc){
+	for(int i = 0; i < inc->count; i++) statement_free(inc->statements[i]);
+	inc->count = 0;
+	inc->sites = 0;
+	inc->live_sites = 0;
+}
+
+// Free the last program, the statements it was made of stay with the front end
+static void release_program(PjIncremental *inc){
+	PjProgram *program = inc->program;
+	if(program == NULL) return;
+	if(inc->whole) pj_program_free(program);
+	else {
+		if(program->root){
+			list_free(program->root->value.statements);
+			pj_free(program->root);
+		}
+		pj_free(program);
+	}
+	inc->program = NULL;
+	inc->whole = false;
+}
+
+// Tokenize and parse a single statement numbering sites from sites, the statement owns text from now on.
+// NULL and error filled on syntax errors, shadows is set when it defines a function named like a builtin operator
+static ParsedStatement* parse_text(char *text, int sites, bool *shadows, Error *error){
+	ParsedStatement *statement = (ParsedStatement*)pj_malloc(MEM_PARSER, sizeof(ParsedStatement));
+	statement->text = text;
+	statement->tokens = tokenize(text);
+	statement->next = NULL;
+	Enviroment *symbols = create_global_env(SYMBOL_SIZE);
+	Parser *parser = parser_init(statement->tokens);
+	parser->sites = sites;
+	statement->block = parse_block(parser, symbols, false, error);
+	statement->sites = parser->sites - sites;
+	statement->functions = parser->functions;
+	*shadows = parser_shadows_builtin(symbols);
+	pj_free(parser);
+	env_free(symbols);
+	if(error->type != ERR_NONE){
+		statement_free(statement);
+		return NULL;
+	}
+	return statement;
+}
+
+// Compile source, keeping the parsed statements of the last source that appear in it unchanged. Statements
+// are matched by their text wherever they moved, new and edited ones are parsed and numbered after every site
+// handed out so far. The program stays valid until the next compile, so instances that ran it must be freed
+// by then. NULL and error filled on syntax errors, the statements parsed so far are still kept for the next compile
+const PjProgram* pj_incremental_compile(PjIncremental *inc, const char *source, Error *error){
+	error->err = NULL;
+	error->message = NULL;
+	error->type = ERR_NONE;
+	release_program(inc);
+	//edited statements leave their sites unused, once most sites are unused everything is numbered again
+	if(inc->sites - inc->live_sites > inc->live_sites) drop_statements(inc);
+
+	//statements of the last source by text, equal statements are chained in source order
+	Scope *previous = scope_init(DEFAULT_SIZE);
+	for(int i = inc->count - 1; i >= 0; i--){
+		bool created;
+		ScopeEntry *entry = scope_insert(previous, inc->statements[i]->text, &created);
+		inc->statements[i]->next = created ? NULL : entry->var;
+		entry->var = inc->statements[i];
+	}
+	inc->count = 0;
+	inc->live_sites = 0;
+	inc->parsed = 0;
+
+	trace_begin("parse_incremental", -1);
+	perf_phase_begin(PERF_PARSE);
+	StatementSplitter splitter;
+	splitter_init(&splitter);
+	splitter_feed(&splitter, source, strlen(source));
+	bool shadows = false;
+	const char *text;
+	size_t length;
+	while(splitter_finish(&splitter, &text, &length)){
+		char *copy = (char*)pj_malloc(MEM_PARSER, length + 1);
+		memcpy(copy, text, length);
+		copy[length] = '\0';
+		ScopeEntry *entry = scope_find(previous, copy);
+		ParsedStatement *statement = entry ? entry->var : NULL;
+		if(statement){
+			entry->var = statement->next;
+			statement->next = NULL;
+			pj_free(copy);
+		}
+		else {
+			statement = parse_text(copy, inc->sites, &shadows, error);
+			if(statement == NULL) break;
+			inc->sites += statement->sites;
+			inc->parsed++;
+		}
+		keep_statement(inc, statement);
+		if(shadows) break;
+	}
+	splitter_free(&splitter);
+
+	//statements that are gone are freed, unless the compile failed and the source may be fixed next
+	for(int i = 0; i < (previous->hashed ? previous->capacity : previous->count); i++){
+		if(previous->entries[i].dist == 0) continue;
+		for(ParsedStatement *statement = previous->entries[i].var, *next; statement != NULL; statement = next){
+			next = statement->next;
+			statement->next = NULL;
+			if(error->err != NULL) keep_statement(inc, statement);
+			else statement_free(statement);
+		}
+	}
+	scope_free(previous);
+
+	//a function named like a builtin operator changes how the statements after it parse, the source is parsed in one piece
+	if(shadows){
+		drop_statements(inc);
+		perf_phase_end(PERF_PARSE);
+		trace_end("parse_incremental");
+		inc->program = pj_compile(source, error);
+		inc->whole = inc->program != NULL;
+		return inc->program;
+	}
+	if(error->err != NULL){
+		perf_phase_end(PERF_PARSE);
+		trace_end("parse_incremental");
+		return NULL;
+	}
+
+	PjProgram *program = vm_program_new();
+	List *statements = createList();
+	for(int i = 0; i < inc->count; i++){
+		AST *block = inc->statements[i]->block;
+		if(block)
+			for(Node *curr = block->value.statements->head; curr != NULL; curr = curr->next) list_push(statements, curr->value);
+		program->functions += inc->statements[i]->functions;
+	}
+	if(statements->size > 0) program->root = make_block_node(statements);
+	else list_free(statements);
+	program->sites = inc->sites;
+	analyze_program(program->root);
+	perf_phase_end(PERF_PARSE);
+	trace_end("parse_incremental");
+	DEBUG_LOG(DEBUG_PARSER, DEBUG_INFO, "parsed %d of %d statements", inc->parsed, inc->count);
+	inc->program = program;
+	return program;
+}
+
+void pj_incremental_free(PjIncremental *inc){
+	if(!inc) return;
+	release_program(inc);
+	drop_statements(inc);
+	pj_free(inc->statements);
+	pj_free(inc);
+}
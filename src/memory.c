@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "../includes/memory.h"
+
+/*===================== MEMORY =====================*/
+
+//counted per thread so concurrent instances do not disturb each other's numbers
+static _Thread_local unsigned long allocations = 0;
+
+//every block starts with its size and subsystem so a free can be accounted without the caller knowing either
+typedef union BlockHeader {
+	struct {
+		size_t size;
+		MemTag tag;
+		bool counted; //allocated while accounting was on
+	} block;
+	max_align_t align; //keeps the memory handed out aligned like malloc's
+} BlockHeader;
+
+//blocks move between threads (forked instances join into their parent), so the totals are shared
+typedef struct MemStats {
+	atomic_ulong calls;
+	atomic_ulong bytes;
+	atomic_long live;
+	atomic_long peak;
+} MemStats;
+
+static bool stats_enabled = false;
+static MemStats stats[MEM_TAGS];
+static MemStats total;
+static const char *tag_names[MEM_TAGS] = { "lexer", "parser", "ast", "environment", "runtime", "io", "other" };
+
+static void stats_peak(MemStats *entry, long live){
+	long peak = atomic_load_explicit(&entry->peak, memory_order_relaxed);
+	while(live > peak && !atomic_compare_exchange_weak_explicit(&entry->peak, &peak, live, memory_order_relaxed, memory_order_relaxed));
+}
+
+// Account a change of live bytes, requested is the size asked for by an allocation call, 0 for frees
+static void stats_add(MemTag tag, long live, size_t requested, bool call){
+	MemStats *entries[2] = { &stats[tag], &total };
+	for(int i = 0; i < 2; i++){
+		if(call){
+			atomic_fetch_add_explicit(&entries[i]->calls, 1, memory_order_relaxed);
+			atomic_fetch_add_explicit(&entries[i]->bytes, requested, memory_order_relaxed);
+		}
+		long now = atomic_fetch_add_explicit(&entries[i]->live, live, memory_order_relaxed) + live;
+		if(live > 0) stats_peak(entries[i], now);
+	}
+}
+
+static void* block_init(BlockHeader *header, MemTag tag, size_t size){
+	if(header == NULL) return NULL;
+	header->block.size = size;
+	header->block.tag = tag;
+	header->block.counted = stats_enabled;
+	if(stats_enabled) stats_add(tag, size, size, true);
+	return header + 1;
+}
+
+void* pj_malloc(MemTag tag, size_t size){
+	allocations++;
+	return block_init((BlockHeader*)malloc(sizeof(BlockHeader) + size), tag, size);
+}
+
+void* pj_calloc(MemTag tag, size_t count, size_t size){
+	allocations++;
+	return block_init((BlockHeader*)calloc(1, sizeof(BlockHeader) + count * size), tag, count * size);
+}
+
+// Growing an existing block counts as an allocation, it may move the block.
+// The block stays with the subsystem it was allocated for
+void* pj_realloc(MemTag tag, void *ptr, size_t size){
+	if(ptr == NULL) return pj_malloc(tag, size);
+	allocations++;
+	BlockHeader *header = (BlockHeader*)ptr - 1;
+	size_t old_size = header->block.size;
+	header = (BlockHeader*)realloc(header, sizeof(BlockHeader) + size);
+	if(header == NULL) return NULL;
+	header->block.size = size;
+	if(header->block.counted) stats_add(header->block.tag, (long)size - (long)old_size, size, true);
+	return header + 1;
+}
+
+void pj_free(void *ptr){
+	if(ptr == NULL) return;
+	BlockHeader *header = (BlockHeader*)ptr - 1;
+	if(header->block.counted) stats_add(header->block.tag, -(long)header->block.size, 0, false);
+	free(header);
+}
+
+// Account a fresh block to another subsystem, its allocation call moves along with it
+void pj_retag(void *ptr, MemTag tag){
+	if(ptr == NULL) return;
+	BlockHeader *header = (BlockHeader*)ptr - 1;
+	if(header->block.tag == tag) return;
+	if(header->block.counted){
+		MemStats *from = &stats[header->block.tag], *to = &stats[tag];
+		long size = header->block.size;
+		atomic_fetch_sub_explicit(&from->calls, 1, memory_order_relaxed);
+		atomic_fetch_sub_explicit(&from->bytes, size, memory_order_relaxed);
+		atomic_fetch_sub_explicit(&from->live, size, memory_order_relaxed);
+		atomic_fetch_add_explicit(&to->calls, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&to->bytes, size, memory_order_relaxed);
+		stats_peak(to, atomic_fetch_add_explicit(&to->live, size, memory_order_relaxed) + size);
+	}
+	header->block.tag = tag;
+}
+
+unsigned long pj_allocations(void){
+	return allocations;
+}
+
+// Start accounting, blocks allocated before stay uncounted when they are freed
+void pj_mem_stats_enable(void){
+	stats_enabled = true;
+}
+
+// Calls, bytes requested, bytes still live and the high-water mark of live bytes per subsystem
+void pj_mem_stats_report(FILE *out){
+	fprintf(out, "%-12s %12s %14s %12s %12s\n", "subsystem", "calls", "bytes", "live", "peak");
+	for(int tag = 0; tag <= MEM_TAGS; tag++){
+		MemStats *entry = tag < MEM_TAGS ? &stats[tag] : &total;
+		fprintf(out, "%-12s %12lu %14lu %12ld %12ld\n", tag < MEM_TAGS ? tag_names[tag] : "total",
+			atomic_load(&entry->calls), atomic_load(&entry->bytes), atomic_load(&entry->live), atomic_load(&entry->peak));
+	}
+}
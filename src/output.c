@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "../includes/output.h"
+#include "../includes/memory.h"
+
+/*===================== OUTPUT =====================*/
+
+//two digit pairs, integers are formatted two digits at a time
+static const char digit_pairs[201] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+void output_init(OutputBuffer *out, int fd){
+	out->data = NULL;
+	out->length = 0;
+	out->capacity = 0;
+	out->fd = fd;
+}
+
+static void write_all(int fd, const char *data, size_t length){
+	while(length > 0){
+		ssize_t written = write(fd, data, length);
+		if(written <= 0) return;
+		data += written;
+		length -= written;
+	}
+}
+
+// Make room for length more bytes, buffers without a file descriptor grow instead of flushing
+static void output_reserve(OutputBuffer *out, size_t length){
+	if(out->length + length <= out->capacity) return;
+	if(out->fd >= 0 && out->capacity > 0){
+		output_flush(out);
+		if(length <= out->capacity) return;
+	}
+	size_t capacity = out->capacity ? out->capacity : OUTPUT_BUFFER_SIZE;
+	while(capacity < out->length + length) capacity *= 2;
+	out->data = (char*)pj_realloc(MEM_IO, out->data, capacity);
+	out->capacity = capacity;
+}
+
+void output_write(OutputBuffer *out, const char *data, size_t length){
+	//writes larger than the buffer skip it
+	if(out->fd >= 0 && length >= OUTPUT_BUFFER_SIZE){
+		output_flush(out);
+		write_all(out->fd, data, length);
+		return;
+	}
+	output_reserve(out, length);
+	memcpy(out->data + out->length, data, length);
+	out->length += length;
+}
+
+void output_str(OutputBuffer *out, const char *str){
+	output_write(out, str, strlen(str));
+}
+
+void output_int(OutputBuffer *out, long long value){
+	char digits[24];
+	char *end = digits + sizeof(digits), *curr = end;
+	//negated as unsigned so the smallest value does not overflow
+	unsigned long long magnitude = value < 0 ? 0ull - (unsigned long long)value : (unsigned long long)value;
+	while(magnitude >= 100){
+		unsigned int pair = (magnitude % 100) * 2;
+		magnitude /= 100;
+		*--curr = digit_pairs[pair + 1];
+		*--curr = digit_pairs[pair];
+	}
+	if(magnitude >= 10){
+		*--curr = digit_pairs[magnitude * 2 + 1];
+		*--curr = digit_pairs[magnitude * 2];
+	}
+	else *--curr = '0' + magnitude;
+	if(value < 0) *--curr = '-';
+	output_write(out, curr, end - curr);
+}
+
+// Shortest decimal that reads back as the same double
+void output_float(OutputBuffer *out, double value){
+	if(isnan(value)){ output_str(out, "nan"); return; }
+	if(isinf(value)){ output_str(out, value < 0 ? "-inf" : "inf"); return; }
+	//whole numbers in range take the integer path
+	if(fabs(value) < 1e15 && value == (double)(long long)value){
+		output_int(out, (long long)value);
+		return;
+	}
+	//values with a few decimals are found by scaling, the fewest decimals give the shortest digits
+	if(fabs(value) < 1e7 && fabs(value) >= 1e-3){
+		double scale = 1;
+		for(int decimals = 1; decimals <= 6; decimals++){
+			scale *= 10;
+			long long scaled = llround(value * scale);
+			if(scaled / scale != value) continue;
+			if(scaled < 0){
+				output_write(out, "-", 1);
+				scaled = -scaled;
+			}
+			long long whole = scaled / (long long)scale, fraction = scaled % (long long)scale;
+			output_int(out, whole);
+			char digits[8];
+			for(int i = decimals - 1; i >= 0; i--, fraction /= 10) digits[i] = '0' + fraction % 10;
+			//trailing zeros cannot remain, a shorter scale would have matched
+			output_write(out, ".", 1);
+			output_write(out, digits, decimals);
+			return;
+		}
+	}
+	char text[32];
+	int length = 0;
+	for(int precision = 1; precision <= 17; precision++){
+		length = snprintf(text, sizeof(text), "%.*g", precision, value);
+		if(strtod(text, NULL) == value) break;
+	}
+	output_write(out, text, length);
+}
+
+void output_value(OutputBuffer *out, RuntimeVal value){
+	switch(value.type){
+		case RESULT_BOOL: 	output_str(out, value.value.b_value ? "true" : "false"); break;
+		case RESULT_INT: 		output_int(out, value.value.i_value); break;
+		case RESULT_FLOAT: 	output_float(out, value.value.f_value); break;
+		case RESULT_LIST:
+			output_write(out, "[", 1);
+			for(int i = 0; i < value.value.list->size; i++){
+				if(i > 0) output_write(out, ", ", 2);
+				output_value(out, value.value.list->items[i]);
+			}
+			output_write(out, "]", 1);
+			break;
+		case RESULT_SLICE: 	output_write(out, value.value.slice.data, value.value.slice.length); break;
+		default: output_str(out, "nothing");
+	}
+}
+
+// Same layout as print_runtime_val, numbers use the formatters above
+void output_runtime_val(OutputBuffer *out, RuntimeVal value){
+	if(is_error(value) && !is_none(value)){
+		output_str(out, value.error);
+		output_write(out, " ", 1);
+		output_str(out, value.value.msg);
+		output_write(out, "\n", 1);
+		return;
+	}
+	output_str(out, "{ type: ");
+	switch(value.type){
+		case RESULT_BOOL:				output_str(out, "bool"); 	break;
+		case RESULT_INT: 				output_str(out, "int"); 	break;
+		case RESULT_FLOAT: 			output_str(out, "float"); 	break;
+		case RESULT_NONE:				output_str(out, "null");	break;
+		case RESULT_FUNCTION:		output_str(out, "function");	break;
+		case RESULT_LIST:				output_str(out, "list");	break;
+		case RESULT_SLICE:			output_str(out, "slice");	break;
+		default: output_str(out, "not supported yet");
+	}
+	output_str(out, ", value: ");
+	output_value(out, value);
+	output_str(out, " }\n");
+}
+
+void output_flush(OutputBuffer *out){
+	if(out->fd < 0 || out->length == 0) return;
+	write_all(out->fd, out->data, out->length);
+	out->length = 0;
+}
+
+void output_free(OutputBuffer *out){
+	output_flush(out);
+	pj_free(out->data);
+	output_init(out, out->fd);
+}
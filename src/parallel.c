@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include "../includes/ast.h"
+#include "../includes/vm.h"
+#include "../includes/pool.h"
+
+/*===================== Parallel builtins =====================*/
+
+//ranges are cut into at most this many chunks whatever the thread count,
+//so a reduction groups its operands the same way on every run
+#define PAR_CHUNKS 64
+
+typedef struct ParallelChunk {
+	PjVM *vm; //instance the chunk runs on, forked before the chunk is queued
+	AST *function;
+	Enviroment *owner; //scope defining function
+	AST *reducer; //script reducer, NULL when op is a builtin operator
+	Enviroment *reducer_owner;
+	NodeType op;
+	int64_t start;
+	int64_t end;
+	RuntimeVal *results; //pmap, one slot per index of the chunk
+	RuntimeVal acc; //preduce, fold of the chunk
+} ParallelChunk;
+
+static bool is_failure(RuntimeVal val){ return is_error(val) && !is_none(val); }
+
+static RuntimeVal list_val(RuntimeList *list){
+	RuntimeVal val;
+	val.type = RESULT_LIST;
+	val.value.list = list;
+	val.retval = false;
+	return val;
+}
+
+static RuntimeVal int_val(int64_t value){
+	RuntimeVal val;
+	val.type = RESULT_INT;
+	val.value.i_value = value;
+	val.retval = false;
+	return val;
+}
+
+// Combine two values with the chunk's reducer
+static RuntimeVal reduce(ParallelChunk *chunk, PjVM *vm, RuntimeVal left, RuntimeVal right){
+	if(chunk->reducer == NULL) return binary_op(chunk->op, left, right);
+	RuntimeVal args[2] = { left, right };
+	return apply_function(vm, chunk->reducer, chunk->reducer_owner, args, 2);
+}
+
+static void run_chunk(void *arg){
+	ParallelChunk *chunk = (ParallelChunk*)arg;
+	for(int64_t i = chunk->start; i < chunk->end; i++){
+		RuntimeVal index = int_val(i);
+		RuntimeVal value = apply_function(chunk->vm, chunk->function, chunk->owner, &index, 1);
+		if(chunk->results){
+			chunk->results[i - chunk->start] = value;
+			continue;
+		}
+		chunk->acc = i == chunk->start || is_failure(value) ? value : reduce(chunk, chunk->vm, chunk->acc, value);
+		if(is_failure(chunk->acc)) return;
+	}
+}
+
+// Resolve a function passed by name
+static AST* resolve_function(AST *arg, Enviroment *env, Enviroment **owner){
+	if(arg == NULL || arg->type != NODE_VARIABLE) return NULL;
+	ScopeEntry *entry = env_lookup(env, arg->value.var.vname, true, NULL, owner);
+	if(entry == NULL) return NULL;
+	NodeType type = ((AST*)entry->fn)->type;
+	if(type != NODE_FUNCTION && type != NODE_NATIVE) return NULL;
+	return entry->fn;
+}
+
+// Builtin operator passed by name to preduce
+static int reducer_operator(AST *arg){
+	if(arg == NULL || arg->type != NODE_VARIABLE) return -1;
+	char *name = arg->value.var.vname;
+	if(strcmp(name, "add") == 0) 		return NODE_ADD;
+	else if(strcmp(name, "sub") == 0) 	return NODE_SUB;
+	else if(strcmp(name, "mul") == 0) 	return NODE_MUL;
+	else if(strcmp(name, "div") == 0) 	return NODE_DIV;
+	return -1;
+}
+
+// Apply a function to every index of [start, end) on the thread pool, folding the results when reduce is set
+static RuntimeVal parallel_range(AST *root, Enviroment *env, bool reduce_results){
+	List *operands = root->value.arguments;
+	int expected = reduce_results ? 4 : 3;
+	if(operands->size != expected)
+		return make_error(RESULT_ERROR_SYNTAX, reduce_results ? "`preduce` accepts exactly four arguments." : "`pmap` accepts exactly three arguments.");
+
+	Node *curr = operands->head;
+	ParallelChunk base;
+	memset(&base, 0, sizeof(ParallelChunk));
+	base.function = resolve_function(curr->value, env, &base.owner);
+	if(base.function == NULL) return make_error(RESULT_ERROR_UNDEFINED, "expected a function name as first argument");
+	curr = curr->next;
+
+	if(reduce_results){
+		int op = reducer_operator(curr->value);
+		if(op != -1) base.op = op;
+		else base.reducer = resolve_function(curr->value, env, &base.reducer_owner);
+		if(op == -1 && base.reducer == NULL)
+			return make_error(RESULT_ERROR_UNDEFINED, "expected a function or operator name as reducer");
+		curr = curr->next;
+	}
+
+	RuntimeVal start = eval_expr(curr->value, env);
+	RuntimeVal end = eval_expr(curr->next->value, env);
+	if(is_error(start) || is_error(end)) return is_error(start) ? start : end;
+	if(!is_number(start) || !is_number(end)) return make_error(RESULT_ERROR_VALUE, "range bounds must be numbers");
+
+	int64_t from = coerce_to_int(start).value.i_value, to = coerce_to_int(end).value.i_value;
+	int64_t size = 0;
+	if(to > from && __builtin_sub_overflow(to, from, &size)) return make_error(RESULT_ERROR_VALUE, "range is too large");
+	RuntimeList *list = NULL;
+	if(!reduce_results){
+		//lists are indexed by int
+		if(size > INT_MAX) return make_error(RESULT_ERROR_VALUE, "range is too large for a list");
+		list = vm_new_list(env->vm, size);
+		if(size == 0) return list_val(list);
+	}
+	else if(size == 0) return make_error(RESULT_ERROR_VALUE, "`preduce` over an empty range");
+
+	int count = size < PAR_CHUNKS ? (int)size : PAR_CHUNKS;
+	int64_t step = size / count + (size % count != 0);
+	count = (int)(size / step + (size % step != 0));
+	ParallelChunk chunks[count];
+	TaskGroup group;
+	atomic_init(&group.pending, 0);
+	for(int i = 0; i < count; i++){
+		chunks[i] = base;
+		chunks[i].start = from + i * step;
+		chunks[i].end = step < to - chunks[i].start ? chunks[i].start + step : to;
+		chunks[i].results = list ? list->items + i * step : NULL;
+		chunks[i].vm = vm_fork(env->vm);
+		pool_spawn(&group, run_chunk, &chunks[i]);
+	}
+	pool_wait(&group);
+	for(int i = 0; i < count; i++) vm_join(env->vm, chunks[i].vm);
+
+	if(!reduce_results){
+		for(int64_t i = 0; i < size; i++)
+			if(is_failure(list->items[i])) return list->items[i];
+		return list_val(list);
+	}
+
+	//chunk results are combined in index order on this thread
+	RuntimeVal acc = chunks[0].acc;
+	for(int i = 1; i < count && !is_failure(acc); i++)
+		acc = is_failure(chunks[i].acc) ? chunks[i].acc : reduce(&base, env->vm, acc, chunks[i].acc);
+	return acc;
+}
+
+RuntimeVal builtin_function_pmap(AST *root, Enviroment *env){
+	return parallel_range(root, env, false);
+}
+
+RuntimeVal builtin_function_preduce(AST *root, Enviroment *env){
+	return parallel_range(root, env, true);
+}
+
+/*===================== Fork join =====================*/
+
+typedef struct ForkTask {
+	PjVM *vm; //forked on the spawning thread, the parent keeps running meanwhile
+	AST *expr;
+	Enviroment *env;
+	RuntimeVal result;
+} ForkTask;
+
+static void run_fork(void *arg){
+	ForkTask *task = (ForkTask*)arg;
+	//empty scope tying the operand's lookups and calls to the forked instance
+	Enviroment *scope = env_new_scope(task->env, task->vm, 1);
+	task->result = eval_expr(task->expr, scope);
+	env_free(scope);
+}
+
+// Evaluate the left operand as a task while this thread evaluates the right one,
+// only called for operands the analysis found pure
+RuntimeVal fork_binary_expr(AST *root, Enviroment *env){
+	ForkTask task = { vm_fork(env->vm), root->left, env, { 0 } };
+	TaskGroup group;
+	atomic_init(&group.pending, 0);
+	pool_spawn(&group, run_fork, &task);
+
+	RuntimeVal right = eval_expr(root->right, env);
+	pool_wait(&group);
+	vm_join(env->vm, task.vm);
+
+	return binary_op(root->type, task.result, right);
+}
@@ -1,4 +1,8 @@
 #include "../includes/parser.h"
+#include "../includes/memory.h"
+#include "../includes/debug.h"
+#include "../includes/analysis.h"
+#include "../includes/trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -73,15 +77,21 @@ object_expr			:= KEYWORD | KEYWORD COLON object | expr
 
 */
 
-#define UNKNOWN_KEYWORD -1
+static LazyBody* parser_skip_body(Parser *parser, Enviroment *env);
+
+bool parse_lazily = true;
 
 /*===================== PARSER =====================*/
 
 // Initialize the parser with a list of tokens
 Parser* parser_init(List *tokens){
-	Parser *parser = (Parser*)malloc(sizeof(Parser)); 
+	Parser *parser = (Parser*)pj_malloc(MEM_PARSER, sizeof(Parser)); 
 	parser->tokens = tokens; 
 	parser->curr_token = tokens->head;
+	parser->curr_tok_type = tokens->head ? ((Token*)tokens->head->value)->type : -1;
+	parser->sites = 0;
+	parser->functions = 0;
+	parser->lazy = parse_lazily;
 	return parser; 
 }
 
@@ -149,7 +159,7 @@ AST *parse_block(Parser *parser, Enviroment *env, bool is_func_statement, Error
 	while (!is_parser_eof(parser) && parser->curr_tok_type == TOKEN_NEWLINE) {
 		parser_next(parser, error); // Consume newline
 		if (error->type != ERR_NONE) return NULL;
-		if (parser->curr_tok_type == TOKEN_RBRACE) break; // End of block
+		if (is_parser_eof(parser) || parser->curr_tok_type == TOKEN_RBRACE) break; // End of block
 
 		statement = parse_statement(parser, env, is_func_statement, error);
 		if (error->type != ERR_NONE) return NULL;
@@ -157,6 +167,7 @@ AST *parse_block(Parser *parser, Enviroment *env, bool is_func_statement, Error
 	}
 
     AST *block = make_block_node(statements);
+	DEBUG_LOG(DEBUG_PARSER, DEBUG_VERBOSE, "block of %d statements", statements->size);
 
     // Skip trailing newlines
 	while (!is_parser_eof(parser) && parser_peek(parser, error)->type == TOKEN_NEWLINE)
@@ -294,6 +305,7 @@ AST* parse_function(Parser *parser, Enviroment *env, Error *error){
 		}
 		token = parser_next(parser, error); //consume function name
 		char *fname = token->value;
+		parser->functions++;
 		parser_next(parser, error); //consume semicolon
 		if(error->type != ERR_NONE) return NULL;
 
@@ -305,14 +317,21 @@ AST* parse_function(Parser *parser, Enviroment *env, Error *error){
 		}
 		parser_next(parser, error); // consume =>
 
-		//define the function in the enviroment before parsing its body
-		env_define_func(env, fname, make_var_node(fname)); 
-		Enviroment *scope = env_init(DEFAULT_SIZE);
-		scope->parent = env;
+		//the body is parsed in its own scope, calls get a fresh scope at runtime
 		if(!is_parser_eof(parser) && parser->curr_tok_type == TOKEN_LBRACE){
 			parser_next(parser, error); // consume {
 			parser_next(parser, error); // consume newline
+			LazyBody *lazy = parser->lazy ? parser_skip_body(parser, env) : NULL;
+			if(lazy){
+				parser_next(parser, error); // consume }
+				AST *function = make_func_node(fname, NULL, parameters);
+				function->value.fn.lazy = lazy;
+				env_define_func(env, fname, function);
+				return function;
+			}
+			Enviroment *scope = env_new_scope(env, NULL, DEFAULT_SIZE);
 			AST *fn_body = parse_block(parser, scope, true, error);
+			env_free(scope);
 			if(error->type != ERR_NONE) return NULL;
 			if(parser->curr_tok_type != TOKEN_RBRACE){
 				parse_error(ERR_SYNTAX, &error, "Expected } after function declation");
@@ -320,14 +339,14 @@ AST* parse_function(Parser *parser, Enviroment *env, Error *error){
 			}
 			parser_next(parser, error); // consume }
 			env_define_func(env, fname, fn_body);
-			return make_func_node(fname, fn_body, parameters, scope);
+			return make_func_node(fname, fn_body, parameters);
 		}
 
 
 		AST *fn_body = parse_statement(parser, env, true, error);
 		if(error->type != ERR_NONE) return NULL;
 		env_define_func(env, fname, fn_body);
-		return make_func_node(fname, fn_body, parameters, scope);
+		return make_func_node(fname, fn_body, parameters);
 	}
 
 	parse_error(ERR_SYNTAX, &error, "Expected a function declaration.");
@@ -472,12 +491,11 @@ AST*	parse_call_expr(Parser *parser, Enviroment* env, Error *error){
 	Token *token = parser_peek(parser, error);
 	if(error->type != ERR_NONE) return NULL;
 	
-	//if the keyword is a defined function
-	AST *function = (AST*)env_get_function(env, token->value);
-	if(!function) return NULL;
+	//calls are resolved at runtime, only the builtin operators are left to parse_builtin_operator
+	if(!env_get_function(env, token->value) && builtin_operators(token) != UNKNOWN_KEYWORD) return NULL;
 
 	parser_next(parser, error); // consume keyword
-	if(is_parser_eof(parser)) return function;
+	if(is_parser_eof(parser)) return parser_site(parser, make_var_node(token->value));
 
 	Token *current = parser_peek(parser, error);
 	if(!current || current->type != TOKEN_LPAREN){
@@ -496,7 +514,7 @@ AST*	parse_call_expr(Parser *parser, Enviroment* env, Error *error){
 		}
 		parser_next(parser, error); //consume )
 
-		return make_call_node(token->value, args);
+		return parser_site(parser, make_call_node(token->value, args));
 	}
 	return NULL;
 }
@@ -508,9 +526,11 @@ AST* parse_factor(Parser *parser, Enviroment* env, Error *error){
 
 	if(token->type == TOKEN_KEYWORD){
 
-		//if the keyword is a defined variable
-		AST *variable = (AST*)env_get_var(env, token->value);
-		if(variable) return variable;
+		//if the keyword is a defined variable, its value is looked up at runtime
+		if(env_get_var(env, token->value)){
+			parser_next(parser, error);
+			return parser_site(parser, make_var_node(token->value));
+		}
 
 		//handle call expressionc case
 		Token *skip_token = parser_skip(parser, 1, error);
@@ -518,10 +538,10 @@ AST* parse_factor(Parser *parser, Enviroment* env, Error *error){
 			AST *call_expr = parse_call_expr(parser, env, error);
 			if(call_expr) return call_expr;
 		}
-		//if the keyword is a known operator ie. add / mul / div 
-		else if(builtin_operators(token) == UNKNOWN_KEYWORD){
+		//names not followed by ( are variables, including operator names passed to pmap / preduce
+		else {
 			parser_next(parser, error);
-			return make_var_node(token->value);
+			return parser_site(parser, make_var_node(token->value));
 		}
 
 		return parse_builtin_operator(parser, env, error);
@@ -533,7 +553,10 @@ AST* parse_factor(Parser *parser, Enviroment* env, Error *error){
 	}
 	else if(token->type == TOKEN_INT){
 		parser_next(parser, error); 
-		return make_int_node(str_to_int(token->value));
+		int64_t value;
+		if(str_to_int(token->value, &value)) return make_int_node(value);
+		//literals past the int range are doubles, as are int operations that overflow
+		return make_float_node(str_to_float(token->value));
 	}
 	else if(token->type == TOKEN_LBRACE){
 		return parse_object(parser, env, error);
@@ -573,7 +596,7 @@ AST *parse_object(Parser *parser, Enviroment *env, Error *error) {
 			ht_add(&properties, token->value, expr);
 		} else {
 			// If there's no colon, assume a shorthand property: { key }
-			ht_add(&properties, token->value, make_var_node(token->value));
+			ht_add(&properties, token->value, parser_site(parser, make_var_node(token->value)));
 		}
 		if(!is_parser_eof(parser) && parser_peek(parser, error)->type == TOKEN_COMMA)
 			parser_next(parser, error);
@@ -592,6 +615,85 @@ AST *parse_object(Parser *parser, Enviroment *env, Error *error) {
 	return make_object_node(properties);
 }
 
+// Scan a function body up to its closing brace without parsing it, leaving the parser on the brace.
+// Sites are reserved for every name in the body, each name makes at most one site. NULL when the body
+// has to be parsed now: it is not closed, or it calls a function named like a builtin operator, which
+// only parses as a call while the definitions seen so far are known
+static LazyBody* parser_skip_body(Parser *parser, Enviroment *env){
+	int depth = 0, names = 0;
+	Node *curr = parser->curr_token;
+	for(; curr != NULL; curr = curr->next){
+		Token *token = curr->value;
+		if(token->type == TOKEN_LBRACE) depth++;
+		else if(token->type == TOKEN_RBRACE && depth-- == 0) break;
+		else if(token->type == TOKEN_KEYWORD){
+			if(builtin_operators(token) != UNKNOWN_KEYWORD && env_get_function(env, token->value)) return NULL;
+			names++;
+		}
+	}
+	if(curr == NULL) return NULL;
+
+	LazyBody *lazy = (LazyBody*)pj_malloc(MEM_PARSER, sizeof(LazyBody));
+	lazy->start = parser->curr_token;
+	lazy->site = parser->sites;
+	atomic_init(&lazy->body, NULL);
+	atomic_init(&lazy->error, NULL);
+	parser->sites += names;
+	parser->curr_token = curr;
+	parser->curr_tok_type = TOKEN_RBRACE;
+	return lazy;
+}
+
+// Parse the body of a lazily parsed function on its first call. Threads calling it at the same time
+// may both parse it, the first to finish publishes its body and the others free theirs.
+// NULL and error filled when the body has a syntax error
+AST* parse_function_body(AST *function, Error *error){
+	error->err = NULL;
+	error->message = NULL;
+	error->type = ERR_NONE;
+	LazyBody *lazy = function->value.fn.lazy;
+	AST *body = atomic_load_explicit(&lazy->body, memory_order_acquire);
+	if(body) return body;
+	char *failed = atomic_load(&lazy->error);
+	if(failed){
+		parse_error(ERR_SYNTAX, &error, failed);
+		return NULL;
+	}
+
+	trace_begin("parse_function", -1);
+	Parser parser = { NULL, lazy->start, ((Token*)lazy->start->value)->type, lazy->site, 0, true };
+	Enviroment *symbols = create_global_env(DEFAULT_SIZE);
+	Enviroment *scope = env_new_scope(symbols, NULL, DEFAULT_SIZE);
+	body = parse_block(&parser, scope, true, error);
+	env_free(scope);
+	env_free(symbols);
+	if(error->type == ERR_NONE && parser.curr_tok_type != TOKEN_RBRACE)
+		parse_error(ERR_SYNTAX, &error, "Expected } after function declation");
+	if(error->type != ERR_NONE){
+		trace_end("parse_function");
+		ast_free(body);
+		atomic_store(&lazy->error, error->message);
+		return NULL;
+	}
+	analyze_body(function, body);
+	trace_end("parse_function");
+
+	AST *published = NULL;
+	if(!atomic_compare_exchange_strong_explicit(&lazy->body, &published, body, memory_order_acq_rel, memory_order_acquire)){
+		ast_free(body);
+		return published;
+	}
+	DEBUG_LOG(DEBUG_PARSER, DEBUG_INFO, "parsed body of `%s`", function->value.fn.fname);
+	return body;
+}
+
+// Number a variable or call node so each reference site gets its own inline cache
+AST* parser_site(Parser *parser, AST *node){
+	if(node->type == NODE_CALL) node->value.call_expr.site = parser->sites++;
+	else node->value.var.site = parser->sites++;
+	return node;
+}
+
 void skip_newline(Parser *parser, Error *error) {
     while (!is_parser_eof(parser) && parser->curr_tok_type == TOKEN_NEWLINE) {
         parser_next(parser, error);
@@ -673,41 +775,46 @@ List* parse_parameters(Parser *parser, Enviroment* env, Error *error){
 	return parameters;
 }
 
+// Whether env defines a function named like a builtin operator. Calls to such a name parse as calls
+// from its definition on, so the statements after it cannot be parsed without it
+bool parser_shadows_builtin(Enviroment *env){
+	Scope *names = env->names;
+	int slots = names->hashed ? names->capacity : names->count;
+	for(int i = 0; i < slots; i++){
+		ScopeEntry *entry = &names->entries[i];
+		if(entry->dist == 0 || entry->fn == NULL) continue;
+		Token token = { entry->name, TOKEN_KEYWORD };
+		if(builtin_operators(&token) != UNKNOWN_KEYWORD) return true;
+	}
+	return false;
+}
+
 // Determine the type of function based on keyword
 NodeType builtin_operators(Token *token){
 	if(strcmp(token->value, "add") == 0) 			return NODE_FUNCTION_ADD;
 	else if(strcmp(token->value, "sub") == 0)		return NODE_FUNCTION_SUB;
 	else if(strcmp(token->value, "mul") == 0)		return NODE_FUNCTION_MUL;
 	else if(strcmp(token->value, "div") == 0) 	return NODE_FUNCTION_DIV;
+	else if(strcmp(token->value, "pmap") == 0) 	return NODE_FUNCTION_PMAP;
+	else if(strcmp(token->value, "print") == 0) 	return NODE_FUNCTION_PRINT;
+	else if(strcmp(token->value, "flush") == 0) 	return NODE_FUNCTION_FLUSH;
+	else if(strcmp(token->value, "preduce") == 0) return NODE_FUNCTION_PREDUCE;
 	
 	return UNKNOWN_KEYWORD; // Return -1 if keyword is not recognized
 }
 
 // Convert string to float
-float str_to_float(char *str){
-	float num = 0; 
-	while(*str != '\0' && *str != '.')
-		num = (num)*10.0 + (*(str++) - '0'); // Convert integer part of the number
-	
-	if(*str != '.') return num;
-
-	str++; // consume '.'
-	float floating = 0;
-	int count = 1;
-	while(*str != '\0' && *str != '.'){
-		floating = (floating * 10.0 + (*(str++) - '0')); // Convert fractional part of the number
-		count *= 10;
-	}
-	num += floating / count;
-	return num; 
+double str_to_float(char *str){
+	return strtod(str, NULL);
 }
 
-// Convert string to float
-int str_to_int(char *str){
-	int num =  0;
+// Convert string to int, false when the number does not fit in an int
+bool str_to_int(char *str, int64_t *value){
+	int64_t num =  0;
 	while(*str != '\0' && *str != '.')
-		num = (num)*10.0 + (*(str++) - '0'); // Convert integer part of the number
-	return num; 
+		if(__builtin_mul_overflow(num, 10, &num) || __builtin_add_overflow(num, *(str++) - '0', &num)) return false;
+	*value = num;
+	return true;
 }
 
 void parse_error(int errorType, Error **err, char *message){
@@ -722,6 +829,7 @@ void parse_error(int errorType, Error **err, char *message){
 	}
 	error->type = errorType;
 	error->message = message;
+	DEBUG_LOG(DEBUG_PARSER, DEBUG_INFO, "%s %s", error->err, message);
 }
 
 bool is_boolean_node(int type){
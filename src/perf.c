@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdint.h>
+#include "../includes/perf.h"
+#include "../includes/scope.h"
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+bool perf_enabled = false;
+bool perf_functions = false;
+
+//call depth followed for self counts, deeper calls are charged to the deepest one followed
+#define PERF_DEPTH 1024
+
+typedef struct PerfValues {
+	double values[PERF_COUNTERS];
+} PerfValues;
+
+typedef struct PerfFunction {
+	const char *name; //owned by the program, the report is written before programs are freed
+	unsigned long calls;
+	PerfValues self; //counted while the function itself ran, callees excluded
+} PerfFunction;
+
+static const char *counter_names[PERF_COUNTERS] = { "task-clock", "cycles", "instructions", "branches", "branch-misses", "L1d-misses", "LLC-misses" };
+
+//counters are per thread, only the thread that opened them is measured
+static _Thread_local bool perf_thread = false;
+
+static struct {
+	int leader;
+	int fds[PERF_COUNTERS]; //-1 for counters that could not be opened
+	int order[PERF_COUNTERS]; //counter of each value of a group read, in opening order
+	int opened;
+	PerfValues phases[PERF_PHASES];
+	PerfValues phase_start[PERF_PHASES];
+	int phase_depth[PERF_PHASES]; //only the outermost of nested spans of a phase is counted
+	bool count_functions;
+	PerfFunction functions[PERF_FUNCTIONS];
+	int stack[PERF_DEPTH]; //function of every active call, -1 for functions past the table
+	int depth;
+	PerfValues last; //values at the last call boundary
+} perf;
+
+static void values_add(PerfValues *to, const PerfValues *now, const PerfValues *since){
+	for(int i = 0; i < PERF_COUNTERS; i++) to->values[i] += now->values[i] - since->values[i];
+}
+
+#ifdef __linux__
+
+static int counter_open(PerfCounter counter, int group){
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	switch(counter){
+		case PERF_TASK_CLOCK:		attr.type = PERF_TYPE_SOFTWARE; attr.config = PERF_COUNT_SW_TASK_CLOCK; break;
+		case PERF_CYCLES:				attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+		case PERF_INSTRUCTIONS:		attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+		case PERF_BRANCHES:			attr.config = PERF_COUNT_HW_BRANCH_INSTRUCTIONS; break;
+		case PERF_BRANCH_MISSES:	attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+		case PERF_L1D_MISSES:
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			break;
+		default:
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			break;
+	}
+	attr.disabled = group == -1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+// Current value of every counter, scaled up when the kernel had to multiplex the group
+static void perf_read(PerfValues *out){
+	uint64_t data[3 + PERF_COUNTERS];
+	memset(out, 0, sizeof(PerfValues));
+	if(read(perf.leader, data, sizeof(data)) < (ssize_t)(3 * sizeof(uint64_t))) return;
+	double scale = data[2] > 0 ? (double)data[1] / data[2] : 0;
+	for(uint64_t i = 0; i < data[0] && i < (uint64_t)perf.opened; i++)
+		out->values[perf.order[i]] = data[3 + i] * scale;
+}
+
+// Open the counter group for the calling thread, functions also counts every script function's own share
+bool perf_start(bool functions){
+	perf.leader = -1;
+	perf.opened = 0;
+	int first_error = 0;
+	for(int counter = 0; counter < PERF_COUNTERS; counter++){
+		perf.fds[counter] = counter_open(counter, perf.leader);
+		if(perf.fds[counter] < 0){
+			if(!first_error) first_error = errno;
+			continue;
+		}
+		if(perf.leader == -1) perf.leader = perf.fds[counter];
+		perf.order[perf.opened++] = counter;
+	}
+	if(perf.leader == -1){
+		fprintf(stderr, "perf-counters: perf_event_open failed: %s\n", strerror(first_error));
+		return false;
+	}
+	if(perf.opened < PERF_COUNTERS){
+		fprintf(stderr, "perf-counters: not available:");
+		for(int counter = 0; counter < PERF_COUNTERS; counter++)
+			if(perf.fds[counter] < 0) fprintf(stderr, " %s", counter_names[counter]);
+		fprintf(stderr, "\n");
+	}
+	ioctl(perf.leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(perf.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	perf_thread = true;
+	perf_enabled = true;
+	perf_functions = perf.count_functions = functions;
+	return true;
+}
+
+#else
+
+static void perf_read(PerfValues *out){
+	memset(out, 0, sizeof(PerfValues));
+}
+
+bool perf_start(bool functions){
+	(void)functions;
+	fprintf(stderr, "perf-counters: perf_event_open is only available on linux\n");
+	return false;
+}
+
+#endif
+
+void perf_phase_record(PerfPhase phase, bool begin){
+	if(!perf_thread) return;
+	if(begin){
+		if(perf.phase_depth[phase]++ == 0) perf_read(&perf.phase_start[phase]);
+		return;
+	}
+	if(--perf.phase_depth[phase] > 0) return;
+	PerfValues now;
+	perf_read(&now);
+	values_add(&perf.phases[phase], &now, &perf.phase_start[phase]);
+}
+
+static int function_index(const char *name){
+	unsigned int index = scope_hash((char*)name) & (PERF_FUNCTIONS - 1);
+	for(int probe = 0; probe < PERF_FUNCTIONS; probe++, index = (index + 1) & (PERF_FUNCTIONS - 1)){
+		PerfFunction *function = &perf.functions[index];
+		if(function->name == NULL) function->name = name;
+		if(strcmp(function->name, name) == 0) return index;
+	}
+	return -1;
+}
+
+// Charge what was counted since the last call boundary to the function running until now
+void perf_call_record(const char *name, bool enter){
+	if(!perf_thread) return;
+	PerfValues now;
+	perf_read(&now);
+	int top = perf.depth > 0 ? perf.stack[(perf.depth < PERF_DEPTH ? perf.depth : PERF_DEPTH) - 1] : -1;
+	if(top >= 0) values_add(&perf.functions[top].self, &now, &perf.last);
+	perf.last = now;
+
+	if(enter){
+		int index = function_index(name);
+		if(index >= 0) perf.functions[index].calls++;
+		if(perf.depth < PERF_DEPTH) perf.stack[perf.depth] = index;
+		perf.depth++;
+	}
+	else if(perf.depth > 0) perf.depth--;
+}
+
+/*===================== Report =====================*/
+
+static bool counted(PerfCounter counter){
+#ifdef __linux__
+	return perf.fds[counter] >= 0;
+#else
+	(void)counter;
+	return false;
+#endif
+}
+
+// One row of the report, calls is negative for phases
+static void print_row(const char *name, long calls, const PerfValues *row){
+	const double *v = row->values;
+	fprintf(stderr, "%-16s", name);
+	if(perf.count_functions && calls >= 0) fprintf(stderr, " %10ld", calls);
+	else if(perf.count_functions) fprintf(stderr, " %10s", "");
+	if(counted(PERF_TASK_CLOCK)) fprintf(stderr, " %10.2f", v[PERF_TASK_CLOCK] / 1e6);
+	else fprintf(stderr, " %10s", "-");
+	for(int counter = PERF_CYCLES; counter <= PERF_INSTRUCTIONS; counter++){
+		if(counted(counter)) fprintf(stderr, " %14.0f", v[counter]);
+		else fprintf(stderr, " %14s", "-");
+	}
+	//ipc, share of branches mispredicted and cache misses per thousand instructions
+	bool instructions = counted(PERF_INSTRUCTIONS) && v[PERF_INSTRUCTIONS] > 0;
+	if(instructions && counted(PERF_CYCLES) && v[PERF_CYCLES] > 0) fprintf(stderr, " %6.2f", v[PERF_INSTRUCTIONS] / v[PERF_CYCLES]);
+	else fprintf(stderr, " %6s", "-");
+	if(counted(PERF_BRANCHES) && counted(PERF_BRANCH_MISSES) && v[PERF_BRANCHES] > 0)
+		fprintf(stderr, " %9.2f%%", v[PERF_BRANCH_MISSES] * 100 / v[PERF_BRANCHES]);
+	else fprintf(stderr, " %10s", "-");
+	for(int counter = PERF_L1D_MISSES; counter <= PERF_LLC_MISSES; counter++){
+		if(instructions && counted(counter)) fprintf(stderr, " %9.2f", v[counter] * 1000 / v[PERF_INSTRUCTIONS]);
+		else fprintf(stderr, " %9s", "-");
+	}
+	fprintf(stderr, "\n");
+}
+
+static PerfCounter sort_counter;
+
+static int compare_functions(const void *a, const void *b){
+	double x = ((const PerfFunction*)a)->self.values[sort_counter], y = ((const PerfFunction*)b)->self.values[sort_counter];
+	return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// Stop counting and report every phase, then every function by its own share of cycles or cpu time.
+// Called before the programs whose function names the table points into are freed
+void perf_finish(void){
+	if(!perf_enabled) return;
+	perf_enabled = false;
+	perf_functions = false;
+
+	fprintf(stderr, "%-16s", "phase");
+	if(perf.count_functions) fprintf(stderr, " %10s", "calls");
+	fprintf(stderr, " %10s %14s %14s %6s %10s %9s %9s\n", "cpu_ms", "cycles", "instructions", "ipc", "br-miss", "L1d-mpki", "LLC-mpki");
+	const char *phase_names[PERF_PHASES] = { "lex", "parse", "eval" };
+	for(int phase = 0; phase < PERF_PHASES; phase++) print_row(phase_names[phase], -1, &perf.phases[phase]);
+
+	if(perf.count_functions){
+		sort_counter = counted(PERF_CYCLES) ? PERF_CYCLES : PERF_TASK_CLOCK;
+		qsort(perf.functions, PERF_FUNCTIONS, sizeof(PerfFunction), compare_functions);
+		fprintf(stderr, "functions, own counts without callees:\n");
+		for(int i = 0; i < PERF_FUNCTIONS; i++)
+			if(perf.functions[i].name) print_row(perf.functions[i].name, perf.functions[i].calls, &perf.functions[i].self);
+	}
+#ifdef __linux__
+	for(int counter = 0; counter < PERF_COUNTERS; counter++)
+		if(perf.fds[counter] >= 0) close(perf.fds[counter]);
+#endif
+}
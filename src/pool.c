@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <sched.h>
+#include <unistd.h>
+#include "../includes/pool.h"
+#include "../includes/memory.h"
+
+/*===================== POOL =====================*/
+
+//one pool per process, deque 0 is shared by threads that are not pool workers
+static struct {
+	pthread_t *threads;
+	TaskDeque *deques;
+	int size; //pool workers plus the threads outside the pool
+	int requested; //thread cap set by pool_init, 0 means one per core
+	atomic_int queued;
+	atomic_int sleeping;
+	atomic_bool stop;
+	pthread_mutex_t idle_lock;
+	pthread_cond_t idle;
+	pthread_once_t once;
+} pool = { .once = PTHREAD_ONCE_INIT, .idle_lock = PTHREAD_MUTEX_INITIALIZER, .idle = PTHREAD_COND_INITIALIZER };
+
+static _Thread_local int worker_index = 0;
+
+static void* pool_worker(void *arg);
+static void pool_start(void);
+
+// Cap the number of threads running tasks, must be called before the pool is first used
+void pool_init(int threads){
+	pool.requested = threads;
+	pthread_once(&pool.once, pool_start);
+}
+
+static void pool_start(void){
+	int size = pool.requested > 0 ? pool.requested : (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(size < 1) size = 1;
+
+	pool.size = size;
+	pool.deques = (TaskDeque*)pj_calloc(MEM_OTHER, size, sizeof(TaskDeque));
+	for(int i = 0; i < size; i++){
+		pool.deques[i].capacity = 64;
+		pool.deques[i].tasks = (PoolTask*)pj_malloc(MEM_OTHER, 64 * sizeof(PoolTask));
+		pthread_mutex_init(&pool.deques[i].lock, NULL);
+	}
+	pool.threads = (pthread_t*)pj_calloc(MEM_OTHER, size, sizeof(pthread_t));
+	for(int i = 1; i < size; i++)
+		pthread_create(&pool.threads[i], NULL, pool_worker, (void*)(long)i);
+	atexit(pool_shutdown);
+}
+
+void pool_shutdown(void){
+	if(pool.threads == NULL || atomic_exchange(&pool.stop, true)) return;
+	pthread_mutex_lock(&pool.idle_lock);
+	pthread_cond_broadcast(&pool.idle);
+	pthread_mutex_unlock(&pool.idle_lock);
+	for(int i = 1; i < pool.size; i++) pthread_join(pool.threads[i], NULL);
+}
+
+int pool_size(void){
+	pthread_once(&pool.once, pool_start);
+	return pool.size;
+}
+
+static void deque_push(TaskDeque *deque, PoolTask task){
+	pthread_mutex_lock(&deque->lock);
+	if(deque->bottom - deque->top == deque->capacity){
+		PoolTask *tasks = (PoolTask*)pj_malloc(MEM_OTHER, deque->capacity * 2 * sizeof(PoolTask));
+		for(int i = deque->top; i < deque->bottom; i++)
+			tasks[i % (deque->capacity * 2)] = deque->tasks[i % deque->capacity];
+		pj_free(deque->tasks);
+		deque->tasks = tasks;
+		deque->capacity *= 2;
+	}
+	deque->tasks[deque->bottom++ % deque->capacity] = task;
+	pthread_mutex_unlock(&deque->lock);
+}
+
+// Take a task from the bottom (owner) or the top (thief)
+static bool deque_take(TaskDeque *deque, PoolTask *task, bool steal){
+	if(deque->bottom == deque->top) return false;
+	pthread_mutex_lock(&deque->lock);
+	bool found = deque->bottom > deque->top;
+	if(found){
+		if(steal) *task = deque->tasks[deque->top++ % deque->capacity];
+		else *task = deque->tasks[--deque->bottom % deque->capacity];
+		if(deque->top == deque->bottom) deque->top = deque->bottom = 0;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return found;
+}
+
+// Pop from our own deque, otherwise steal from the others
+static bool pool_take(PoolTask *task){
+	if(deque_take(&pool.deques[worker_index], task, false)) return true;
+	for(int i = 1; i <= pool.size; i++){
+		int victim = (worker_index + i) % pool.size;
+		if(victim != worker_index && deque_take(&pool.deques[victim], task, true)) return true;
+	}
+	return false;
+}
+
+static void pool_run(PoolTask task){
+	atomic_fetch_sub(&pool.queued, 1);
+	task.fn(task.arg);
+	atomic_fetch_sub(&task.group->pending, 1);
+}
+
+static void* pool_worker(void *arg){
+	worker_index = (int)(long)arg;
+	PoolTask task;
+	while(!atomic_load(&pool.stop)){
+		if(pool_take(&task)){
+			pool_run(task);
+			continue;
+		}
+		pthread_mutex_lock(&pool.idle_lock);
+		atomic_fetch_add(&pool.sleeping, 1);
+		while(atomic_load(&pool.queued) == 0 && !atomic_load(&pool.stop))
+			pthread_cond_wait(&pool.idle, &pool.idle_lock);
+		atomic_fetch_sub(&pool.sleeping, 1);
+		pthread_mutex_unlock(&pool.idle_lock);
+	}
+	return NULL;
+}
+
+// Queue fn(arg) as part of group, runs inline when the pool has no workers
+void pool_spawn(TaskGroup *group, PoolTaskFn fn, void *arg){
+	pthread_once(&pool.once, pool_start);
+	if(pool.size == 1){
+		fn(arg);
+		return;
+	}
+
+	PoolTask task = { fn, arg, group };
+	atomic_fetch_add(&group->pending, 1);
+	atomic_fetch_add(&pool.queued, 1);
+	deque_push(&pool.deques[worker_index], task);
+	if(atomic_load(&pool.sleeping) > 0){
+		pthread_mutex_lock(&pool.idle_lock);
+		pthread_cond_signal(&pool.idle);
+		pthread_mutex_unlock(&pool.idle_lock);
+	}
+}
+
+// Run queued tasks until every task of group finished
+void pool_wait(TaskGroup *group){
+	PoolTask task;
+	while(atomic_load(&group->pending) > 0){
+		if(pool_take(&task)) pool_run(task);
+		else sched_yield();
+	}
+}
+
+// Spawning only pays off once the tasks we queued earlier were taken
+bool pool_should_spawn(void){
+	pthread_once(&pool.once, pool_start);
+	if(pool.size == 1) return false;
+	TaskDeque *deque = &pool.deques[worker_index];
+	return deque->bottom == deque->top;
+}
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "../includes/profile.h"
+#include "../includes/memory.h"
+
+bool profile_enabled = false;
+_Thread_local ProfileStack profile_stack;
+//the thread that started profiling, samples of other threads are rooted at the pool
+static _Thread_local bool profile_main = false;
+
+static const char *ROOT_MAIN = "main";
+static const char *ROOT_WORKER = "worker";
+
+// Samples are laid out back to back in a buffer reserved up front, so the handler never allocates:
+// the thread's root frame, its script frames outermost first, then NULL
+static struct {
+	const char **samples;
+	atomic_size_t used;
+	atomic_ulong dropped;
+	const char *path;
+} profiler;
+
+static void profile_sample(int signo){
+	(void)signo;
+	int depth = profile_stack.depth;
+	if(depth > PROFILE_DEPTH) depth = PROFILE_DEPTH;
+	size_t slot = atomic_fetch_add(&profiler.used, depth + 2);
+	if(slot + depth + 2 > PROFILE_BUFFER){
+		atomic_fetch_add(&profiler.dropped, 1);
+		return;
+	}
+	profiler.samples[slot] = profile_main ? ROOT_MAIN : ROOT_WORKER;
+	for(int i = 0; i < depth; i++) profiler.samples[slot + 1 + i] = profile_stack.frames[i];
+	profiler.samples[slot + 1 + depth] = NULL;
+}
+
+// Sample the call stack of whichever thread is using cpu hz times a second, folded stacks are written to path by profile_finish
+bool profile_start(const char *path, int hz){
+	if(hz <= 0) hz = PROFILE_HZ;
+	profiler.samples = (const char**)pj_calloc(MEM_OTHER, PROFILE_BUFFER, sizeof(const char*));
+	atomic_init(&profiler.used, 0);
+	atomic_init(&profiler.dropped, 0);
+	profiler.path = path;
+	profile_main = true;
+	profile_enabled = true;
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = profile_sample;
+	//reads of the REPL must not fail because a sample was taken
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	struct itimerval timer;
+	timer.it_interval.tv_sec = 1 / hz;
+	timer.it_interval.tv_usec = hz > 1 ? 1000000 / hz : 0;
+	timer.it_value = timer.it_interval;
+	if(sigaction(SIGPROF, &action, NULL) < 0 || setitimer(ITIMER_PROF, &timer, NULL) < 0){
+		perror("profile");
+		profile_enabled = false;
+		pj_free(profiler.samples);
+		profiler.samples = NULL;
+		return false;
+	}
+	return true;
+}
+
+typedef struct FoldedStack {
+	const char **frames; //root first, NULL terminated
+} FoldedStack;
+
+static int compare_stacks(const void *a, const void *b){
+	const char **x = ((const FoldedStack*)a)->frames, **y = ((const FoldedStack*)b)->frames;
+	//the same function can come from two copies of a program, so frames compare by name
+	for(; *x && *y; x++, y++){
+		int order = strcmp(*x, *y);
+		if(order != 0) return order;
+	}
+	return (*x != NULL) - (*y != NULL);
+}
+
+static void write_stack(FILE *out, const char **frames, unsigned long count){
+	for(int i = 0; frames[i]; i++) fprintf(out, "%s%s", i > 0 ? ";" : "", frames[i]);
+	fprintf(out, " %lu\n", count);
+}
+
+// Stop sampling and write one `frame;frame;... count` line per distinct stack, the format
+// flamegraph.pl and speedscope load. Called before the programs whose names the frames point into are freed
+void profile_finish(void){
+	if(!profile_enabled) return;
+	struct itimerval timer;
+	memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, NULL);
+	signal(SIGPROF, SIG_IGN);
+	profile_enabled = false;
+
+	size_t used = atomic_load(&profiler.used);
+	if(used > PROFILE_BUFFER) used = PROFILE_BUFFER;
+	size_t count = 0;
+	FoldedStack *stacks = (FoldedStack*)pj_malloc(MEM_OTHER, (used / 2 + 1) * sizeof(FoldedStack));
+	for(size_t slot = 0; slot < used; slot++){
+		//a slot reserved by a sample that was dropped at the end of the buffer stays empty
+		if(profiler.samples[slot] == NULL) continue;
+		stacks[count++].frames = &profiler.samples[slot];
+		while(slot < used && profiler.samples[slot] != NULL) slot++;
+	}
+	qsort(stacks, count, sizeof(FoldedStack), compare_stacks);
+
+	FILE *out = fopen(profiler.path, "w");
+	if(out == NULL) perror(profiler.path);
+	else {
+		unsigned long same = 0;
+		for(size_t i = 0; i < count; i++){
+			same++;
+			if(i + 1 < count && compare_stacks(&stacks[i], &stacks[i + 1]) == 0) continue;
+			write_stack(out, stacks[i].frames, same);
+			same = 0;
+		}
+		fclose(out);
+		fprintf(stderr, "profile: %zu samples written to %s", count, profiler.path);
+		if(atomic_load(&profiler.dropped) > 0) fprintf(stderr, ", %lu dropped", atomic_load(&profiler.dropped));
+		fprintf(stderr, "\n");
+	}
+	pj_free(stacks);
+	pj_free(profiler.samples);
+	profiler.samples = NULL;
+}
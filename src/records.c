@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../includes/records.h"
+#include "../includes/vm.h"
+#include "../includes/parser.h"
+#include "../includes/memory.h"
+
+/*===================== RECORDS =====================*/
+
+//global bound to a part of the current record
+typedef struct RecordBinding {
+	char name[12];
+	ScopeEntry *entry; //resolved again whenever the global scope changes
+} RecordBinding;
+
+typedef struct RecordState {
+	PjVM *vm;
+	RecordBinding bindings[RECORD_MAX_FIELDS + 3]; //line, NR, NF, then the fields
+	int count;
+	unsigned long version; //global scope version the entries were resolved at
+} RecordState;
+
+enum { BIND_LINE, BIND_NR, BIND_NF, BIND_FIELDS };
+
+static RuntimeVal slice_val(const char *data, int length){
+	RuntimeVal val;
+	val.type = RESULT_SLICE;
+	val.value.slice.data = data;
+	val.value.slice.length = length;
+	val.retval = false;
+	return val;
+}
+
+// Field a name like f3 stands for, 0 for other names. Numbers past RECORD_MAX_FIELDS stop growing
+static int field_index(const char *name){
+	if(name[0] != 'f' || name[1] == '\0') return 0;
+	int index = 0;
+	for(const char *digit = name + 1; *digit != '\0'; digit++){
+		if(*digit < '0' || *digit > '9') return 0;
+		if(index <= RECORD_MAX_FIELDS) index = index * 10 + (*digit - '0');
+	}
+	return index;
+}
+
+// Highest field named under node. Programs from images or parsed in chunks keep no single token
+// list, so the tree is searched, lazily parsed bodies included
+static int highest_field(AST *node){
+	if(node == NULL) return 0;
+	int highest = highest_field(node->left), right = highest_field(node->right);
+	if(right > highest) highest = right;
+	int own = 0;
+	List *list = NULL;
+	if(is_builtin_operator(node)) list = node->value.arguments;
+	else switch(node->type){
+		case NODE_BLOCK:		list = node->value.statements; break;
+		case NODE_IF_ELSE:	own = highest_field(node->value.condition); break;
+		case NODE_RETURN:		own = highest_field(node->value.return_expr); break;
+		case NODE_VARIABLE:	own = field_index(node->value.var.vname); break;
+		case NODE_ASSIGN: {
+			own = field_index(node->value.var.vname);
+			int expr = highest_field(node->value.var.expr);
+			if(expr > own) own = expr;
+			break;
+		}
+		case NODE_CALL:		list = node->value.call_expr.arguments; break;
+		case NODE_FUNCTION: {
+			AST *body = node->value.fn.fbody;
+			Error error;
+			if(body == NULL && node->value.fn.lazy) body = parse_function_body(node, &error);
+			own = highest_field(body);
+			break;
+		}
+		default: break;
+	}
+	if(own > highest) highest = own;
+	if(list)
+		for(Node *curr = list->head; curr != NULL; curr = curr->next){
+			int item = highest_field(curr->value);
+			if(item > highest) highest = item;
+		}
+	return highest;
+}
+
+// Highest field the expression names, fields are only split as far as needed
+static int fields_used(const PjProgram *program){
+	int highest = highest_field(program->root);
+	return highest < RECORD_MAX_FIELDS ? highest : RECORD_MAX_FIELDS;
+}
+
+// Bind every name once, records then only rewrite the bound value nodes
+static void bind_record(RecordState *state, int fields){
+	Enviroment *global = state->vm->global;
+	strcpy(state->bindings[BIND_LINE].name, "line");
+	strcpy(state->bindings[BIND_NR].name, "NR");
+	strcpy(state->bindings[BIND_NF].name, "NF");
+	for(int i = 0; i < fields; i++) snprintf(state->bindings[BIND_FIELDS + i].name, sizeof(state->bindings[0].name), "f%d", i + 1);
+	state->count = BIND_FIELDS + fields;
+
+	RuntimeVal zero = slice_val("", 0);
+	for(int i = 0; i < state->count; i++){
+		if(i == BIND_NR || i == BIND_NF) zero.type = RESULT_INT, zero.value.i_value = 0;
+		else zero = slice_val("", 0);
+		env_assign_var(global, state->bindings[i].name, vm_value_node(state->vm, zero));
+	}
+	state->version = 0;
+}
+
+// Overwrite a bound global in place, the value node stays owned by the global scope
+static void set_binding(RecordState *state, int index, RuntimeVal value){
+	AST *node = state->bindings[index].entry->var;
+	if(value.type == RESULT_INT){
+		node->type = NODE_INT;
+		node->value.i_value = value.value.i_value;
+	}
+	else {
+		node->type = NODE_SLICE;
+		node->value.slice = value.value.slice;
+	}
+}
+
+static void load_record(RecordState *state, const char *line, int length, int number, int delimiter){
+	Enviroment *global = state->vm->global;
+	//scripts defining new globals may move the entries
+	if(state->version != global->version){
+		for(int i = 0; i < state->count; i++)
+			state->bindings[i].entry = scope_find(global->names, state->bindings[i].name);
+		state->version = global->version;
+	}
+
+	RuntimeVal value;
+	value.type = RESULT_INT;
+	value.value.i_value = number;
+	set_binding(state, BIND_NR, value);
+	set_binding(state, BIND_LINE, slice_val(line, length));
+
+	int fields = 0, wanted = state->count - BIND_FIELDS;
+	const char *curr = line, *end = line + length;
+	if(delimiter == RECORD_BLANKS){
+		while(true){
+			while(curr < end && (*curr == ' ' || *curr == '\t')) curr++;
+			if(curr == end) break;
+			const char *start = curr;
+			while(curr < end && *curr != ' ' && *curr != '\t') curr++;
+			if(fields < wanted) set_binding(state, BIND_FIELDS + fields, slice_val(start, curr - start));
+			fields++;
+		}
+	}
+	//an empty record has no fields, otherwise every delimiter starts a field
+	else if(length > 0){
+		while(true){
+			const char *found = memchr(curr, delimiter, end - curr);
+			const char *field_end = found ? found : end;
+			if(fields < wanted) set_binding(state, BIND_FIELDS + fields, slice_val(curr, field_end - curr));
+			fields++;
+			if(!found) break;
+			curr = found + 1;
+		}
+	}
+	for(int i = fields; i < wanted; i++) set_binding(state, BIND_FIELDS + i, slice_val("", 0));
+	value.value.i_value = fields;
+	set_binding(state, BIND_NF, value);
+}
+
+// Evaluate expr once per line of path. Records are slices of the mapped file and the
+// globals holding them are rebound in place, so a record costs no allocation
+int pj_run_records(const char *expr, const char *path, int delimiter){
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if(fd < 0 || fstat(fd, &st) < 0){
+		perror(path);
+		if(fd >= 0) close(fd);
+		return 1;
+	}
+	size_t size = st.st_size;
+	const char *data = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : "";
+	close(fd);
+	if(data == MAP_FAILED){
+		perror(path);
+		return 1;
+	}
+	if(size > 0) madvise((void*)data, size, MADV_SEQUENTIAL);
+
+	//the parser expects statements to end with a newline
+	size_t expr_length = strlen(expr);
+	char *source = (char*)pj_malloc(MEM_IO, expr_length + 2);
+	memcpy(source, expr, expr_length);
+	source[expr_length] = '\n';
+	source[expr_length + 1] = '\0';
+	Error error;
+	PjProgram *program = pj_compile(source, &error);
+	pj_free(source);
+	if(program == NULL){
+		printf("%s [%u] %s\n", error.err, error.type, error.message);
+		if(size > 0) munmap((void*)data, size);
+		return 1;
+	}
+
+	RecordState state;
+	state.vm = pj_vm_new();
+	bind_record(&state, fields_used(program));
+
+	int status = 0, number = 0;
+	const char *curr = data, *end = data + size;
+	while(curr < end){
+		const char *newline = memchr(curr, '\n', end - curr);
+		const char *line_end = newline ? newline : end;
+		int length = line_end - curr;
+		if(length > 0 && curr[length - 1] == '\r') length--;
+		load_record(&state, curr, length, ++number, delimiter);
+		curr = newline ? newline + 1 : end;
+
+		RuntimeVal result = pj_vm_eval(state.vm, program);
+		//like awk's {print expr}, a script printing by itself returns nothing
+		if(is_error(result) && !is_none(result)){
+			output_runtime_val(&state.vm->out, result);
+			status = 1;
+			break;
+		}
+		if(!is_none(result) && result.type != RESULT_FUNCTION){
+			output_value(&state.vm->out, result);
+			output_write(&state.vm->out, "\n", 1);
+		}
+	}
+
+	pj_vm_free(state.vm);
+	pj_program_free(program);
+	if(size > 0) munmap((void*)data, size);
+	return status;
+}
@@ -1,9 +1,21 @@
+#include <stdlib.h>
+#include <string.h>
 #include "../includes/runtime_val.h"
+#include "../includes/memory.h"
+
+// Truncate a double to an int, saturating values out of range and mapping NaN to 0
+static int64_t double_to_int(double value){
+    if(value != value) return 0;
+    if(value >= 9223372036854775808.0) return INT64_MAX;
+    if(value < -9223372036854775808.0) return INT64_MIN;
+    return (int64_t)value;
+}
 
 // Helper function to coerce the result to a float if necessary
 RuntimeVal coerce_to_float(RuntimeVal result) {
+    result = slice_to_number(result);
     if (result.type == RESULT_INT) {
-        result.value.f_value = (float)result.value.i_value; // Convert int to float
+        result.value.f_value = (double)result.value.i_value; // Convert int to float
         result.type = RESULT_FLOAT;
     }
     return result;
@@ -11,45 +23,100 @@ RuntimeVal coerce_to_float(RuntimeVal result) {
 
 // Helper function to coerce the result to a int if necessary
 RuntimeVal coerce_to_int(RuntimeVal result) {
+    result = slice_to_number(result);
     if (result.type == RESULT_FLOAT) {
-        result.value.i_value = (int)result.value.f_value; // Convert float to int
+        result.value.i_value = double_to_int(result.value.f_value); // Convert float to int
         result.type = RESULT_INT;
     }
     return result;
 }
 
+// Number written at the start of a slice, like awk a slice without one is 0
+RuntimeVal slice_to_number(RuntimeVal result){
+	if(result.type != RESULT_SLICE) return result;
+	const char *curr = result.value.slice.data, *end = curr + result.value.slice.length;
+	while(curr < end && (*curr == ' ' || *curr == '\t')) curr++;
+	const char *number = curr;
+	bool negative = curr < end && *curr == '-';
+	if(curr < end && (*curr == '-' || *curr == '+')) curr++;
+
+	int64_t whole = 0;
+	bool fits = true;
+	while(curr < end && *curr >= '0' && *curr <= '9'){
+		int digit = *(curr++) - '0';
+		fits = fits && !__builtin_mul_overflow(whole, 10, &whole) && !__builtin_add_overflow(whole, digit, &whole);
+	}
+	result.retval = false;
+	if(curr < end && *curr == '.')
+		for(curr++, fits = false; curr < end && *curr >= '0' && *curr <= '9'; curr++);
+	if(fits){
+		result.type = RESULT_INT;
+		result.value.i_value = negative ? -whole : whole;
+		return result;
+	}
+
+	//fractions and ints past the int range are read by strtod, which needs a terminated copy
+	char buffer[64];
+	size_t length = curr - number;
+	char *text = length < sizeof(buffer) ? buffer : (char*)pj_malloc(MEM_RUNTIME, length + 1);
+	memcpy(text, number, length);
+	text[length] = '\0';
+	result.type = RESULT_FLOAT;
+	result.value.f_value = strtod(text, NULL);
+	if(text != buffer) pj_free(text);
+	return result;
+}
+
 bool is_number(RuntimeVal val){ return val.type == RESULT_INT || val.type == RESULT_FLOAT;}
 bool is_boolean(RuntimeVal val){ return val.type == RESULT_BOOL; }
 bool is_none(RuntimeVal val) { return val.type == RESULT_NONE; }
 
-void print_runtime_val(RuntimeVal result){
-	if(is_error(result)){
-		printf("%s %s\n", result.error, result.value.msg);
+void print_runtime_val(RuntimeVal result){ fprint_runtime_val(stdout, result); }
+void print_value(RuntimeVal result){ fprint_value(stdout, result); }
+
+void fprint_runtime_val(FILE *out, RuntimeVal result){
+	if(is_error(result) && !is_none(result)){
+		fprintf(out, "%s %s\n", result.error, result.value.msg);
 		return;
 	}
-	printf("{ type: ");
+	fprintf(out, "{ type: ");
 	switch(result.type){
-		case RESULT_BOOL:				printf("bool"); 	break;
-		case RESULT_INT: 				printf("int"); 	break;
-		case RESULT_FLOAT: 			printf("float"); 	break;
-		case RESULT_NONE:				printf("null");	break;
-		case RESULT_FUNCTION:		printf("function");	break;
-		default: printf("not supported yet");
+		case RESULT_BOOL:				fprintf(out, "bool"); 	break;
+		case RESULT_INT: 				fprintf(out, "int"); 	break;
+		case RESULT_FLOAT: 			fprintf(out, "float"); 	break;
+		case RESULT_NONE:				fprintf(out, "null");	break;
+		case RESULT_FUNCTION:		fprintf(out, "function");	break;
+		case RESULT_LIST:				fprintf(out, "list");	break;
+		case RESULT_SLICE:			fprintf(out, "slice");	break;
+		default: fprintf(out, "not supported yet");
 	}
-	printf(", value: ");
+	fprintf(out, ", value: ");
+	fprint_value(out, result);
+	fprintf(out, " }\n");
+}
+
+//print the value part of a runtime value, lists print their items
+void fprint_value(FILE *out, RuntimeVal result){
 	switch(result.type){
 		case RESULT_BOOL:
-			if(result.value.b_value) printf("true");
-			else printf("false");
+			if(result.value.b_value) fprintf(out, "true");
+			else fprintf(out, "false");
+			break;
+		case RESULT_INT: 				fprintf(out, "%lld", (long long)result.value.i_value); break;
+		case RESULT_FLOAT: 			fprintf(out, "%f", result.value.f_value); break;
+		case RESULT_NONE:				fprintf(out, "nothing");	break;
+		case RESULT_FUNCTION:		fprintf(out, "nothing");	break;
+		case RESULT_LIST:
+			fprintf(out, "[");
+			for(int i = 0; i < result.value.list->size; i++){
+				if(i > 0) fprintf(out, ", ");
+				fprint_value(out, result.value.list->items[i]);
+			}
+			fprintf(out, "]");
 			break;
-		case RESULT_INT: 				printf("%d", result.value.i_value); break;
-		case RESULT_FLOAT: 			printf("%f", result.value.f_value); break;
-		case RESULT_NONE:				printf("nothing");	break;
-		case RESULT_FUNCTION:		printf("nothing");	break;
-		default: printf("not supported yet");
+		case RESULT_SLICE:			fwrite(result.value.slice.data, 1, result.value.slice.length, out); break;
+		default: fprintf(out, "not supported yet");
 	}
-	
-	printf(" }\n");
 }
 
 bool is_error(RuntimeVal val){
@@ -63,6 +130,7 @@ bool is_error(RuntimeVal val){
 
 RuntimeVal 	make_error(enum EvalNodeType type, char *msg){
 	RuntimeVal err;
+	err.retval = false;
 	if(type == RESULT_ERROR_SYNTAX){
 		err.type = RESULT_ERROR_SYNTAX;
 		err.error = "SyntaxError:";
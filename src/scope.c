@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../includes/scope.h"
+#include "../includes/memory.h"
+
+/*===================== SCOPE =====================*/
+
+static void scope_grow(Scope *scope);
+static ScopeEntry* scope_place(Scope *scope, ScopeEntry entry);
+
+// Initialize an empty scope, the table starts in linear mode
+Scope* scope_init(int size_hint){
+	Scope *scope = (Scope*)pj_malloc(MEM_ENV, sizeof(Scope));
+	scope->entries = NULL;
+	scope->count = 0;
+	scope->capacity = 0;
+	scope->size_hint = size_hint;
+	scope->hashed = false;
+	scope->owns_names = false;
+	return scope;
+}
+
+void scope_free(Scope *scope){
+	if(!scope) return;
+	if(scope->owns_names)
+		for(int i = 0; i < (scope->hashed ? scope->capacity : scope->count); i++)
+			if(scope->entries[i].dist != 0) pj_free(scope->entries[i].name);
+	pj_free(scope->entries);
+	pj_free(scope);
+}
+
+// Remove every name but keep the table, so a recycled scope does not allocate again
+void scope_clear(Scope *scope, int size_hint){
+	if(scope->owns_names)
+		for(int i = 0; i < (scope->hashed ? scope->capacity : scope->count); i++)
+			if(scope->entries[i].dist != 0) pj_free(scope->entries[i].name);
+	if(scope->hashed) memset(scope->entries, 0, scope->capacity * sizeof(ScopeEntry));
+	scope->count = 0;
+	scope->size_hint = size_hint;
+}
+
+// FNV-1a hash of a name
+unsigned int scope_hash(char *name){
+	unsigned int hash = 2166136261u;
+	while(*name){
+		hash ^= (unsigned char)*(name++);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// Find the entry holding name, NULL if the name is not defined in this scope
+ScopeEntry* scope_find(Scope *scope, char *name){
+	if(!scope || scope->count == 0) return NULL;
+	return scope_find_hashed(scope, name, scope_hash(name));
+}
+
+// scope_find for a name whose scope_hash is already known
+ScopeEntry* scope_find_hashed(Scope *scope, char *name, unsigned int hash){
+	if(!scope || scope->count == 0) return NULL;
+
+	if(!scope->hashed){
+		for(int i = 0; i < scope->count; i++){
+			ScopeEntry *entry = &scope->entries[i];
+			if(entry->hash == hash && strcmp(entry->name, name) == 0) return entry;
+		}
+		return NULL;
+	}
+
+	unsigned int mask = scope->capacity - 1;
+	unsigned int index = hash & mask;
+	//an entry closer to its home slot than we are means the name is absent
+	for(unsigned int dist = 1; scope->entries[index].dist >= dist; dist++){
+		ScopeEntry *entry = &scope->entries[index];
+		if(entry->hash == hash && strcmp(entry->name, name) == 0) return entry;
+		index = (index + 1) & mask;
+	}
+	return NULL;
+}
+
+// Find the entry holding name or add an empty one, created is set when the name was added.
+// Adding a name may move other entries, so pointers from earlier lookups are only valid while created is false
+ScopeEntry* scope_insert(Scope *scope, char *name, bool *created){
+	ScopeEntry *entry = scope_find(scope, name);
+	if(created) *created = entry == NULL;
+	if(entry) return entry;
+
+	ScopeEntry fresh = { name, scope_hash(name), 1, NULL, NULL };
+	if(scope->owns_names){
+		fresh.name = (char*)pj_malloc(MEM_ENV, strlen(name) + 1);
+		strcpy(fresh.name, name);
+	}
+	if(!scope->hashed && scope->count < scope->capacity){
+		scope->entries[scope->count] = fresh;
+		return &scope->entries[scope->count++];
+	}
+	//keep the load factor under 3/4
+	if(!scope->hashed || (scope->count + 1) * 4 > scope->capacity * 3) scope_grow(scope);
+
+	scope->count++;
+	if(!scope->hashed){
+		scope->entries[scope->count - 1] = fresh;
+		return &scope->entries[scope->count - 1];
+	}
+	return scope_place(scope, fresh);
+}
+
+// Robin hood insertion, entries richer than the one being placed give up their slot
+static ScopeEntry* scope_place(Scope *scope, ScopeEntry entry){
+	unsigned int mask = scope->capacity - 1;
+	unsigned int index = entry.hash & mask;
+	ScopeEntry *placed = NULL;
+
+	while(true){
+		ScopeEntry *slot = &scope->entries[index];
+		if(slot->dist == 0){
+			*slot = entry;
+			return placed ? placed : slot;
+		}
+		if(slot->dist < entry.dist){
+			ScopeEntry displaced = *slot;
+			*slot = entry;
+			entry = displaced;
+			if(!placed) placed = slot;
+		}
+		index = (index + 1) & mask;
+		entry.dist++;
+	}
+}
+
+// Grow the linear array, switching to the hashed table once it outgrows SCOPE_LINEAR_MAX
+static void scope_grow(Scope *scope){
+	if(!scope->hashed && scope->capacity < SCOPE_LINEAR_MAX){
+		int capacity = scope->capacity == 0 ? 2 : scope->capacity * 2;
+		if(capacity > SCOPE_LINEAR_MAX) capacity = SCOPE_LINEAR_MAX;
+		scope->entries = (ScopeEntry*)pj_realloc(MEM_ENV, scope->entries, capacity * sizeof(ScopeEntry));
+		scope->capacity = capacity;
+		return;
+	}
+
+	int capacity = scope->hashed ? scope->capacity * 2 : SCOPE_LINEAR_MAX * 4;
+	while(capacity < scope->size_hint) capacity *= 2;
+
+	ScopeEntry *old = scope->entries;
+	int old_capacity = scope->capacity, old_count = scope->count;
+	bool was_hashed = scope->hashed;
+
+	scope->entries = (ScopeEntry*)pj_calloc(MEM_ENV, capacity, sizeof(ScopeEntry));
+	scope->capacity = capacity;
+	scope->hashed = true;
+	for(int i = 0; i < (was_hashed ? old_capacity : old_count); i++){
+		if(old[i].dist == 0) continue;
+		ScopeEntry entry = old[i];
+		entry.dist = 1;
+		scope_place(scope, entry);
+	}
+	pj_free(old);
+}
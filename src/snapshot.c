@@ -0,0 +1,109 @@
+#include <string.h>
+#include "../includes/snapshot.h"
+#include "../includes/image.h"
+#include "../includes/memory.h"
+
+/*===================== SNAPSHOT =====================*/
+
+// Save the variables and function definitions of the instance's global scope to path, so a later
+// process can restore them instead of running the script that defined them again
+bool pj_vm_snapshot(PjVM *vm, const char *path){
+	Scope *names = vm->global->names;
+	List *statements = createList();
+	int functions = 0;
+	int slots = names->hashed ? names->capacity : names->count;
+	for(int i = 0; i < slots; i++){
+		ScopeEntry *entry = &names->entries[i];
+		if(entry->dist == 0) continue;
+		if(entry->var) list_push(statements, make_assign_node(entry->name, entry->var));
+		//natives hold C pointers, the embedder registers them again
+		if(entry->fn && ((AST*)entry->fn)->type == NODE_FUNCTION){
+			list_push(statements, entry->fn);
+			functions++;
+		}
+	}
+
+	//sites of the functions index the caches of the programs that defined them
+	AST *root = make_block_node(statements);
+	bool saved = image_save(SNAPSHOT_MAGIC, root, vm->cache_count, functions, 0, path);
+
+	//values and definitions stay with the instance and its programs, only the wrapping nodes are freed
+	for(Node *curr = statements->head; curr != NULL; curr = curr->next){
+		AST *statement = curr->value;
+		if(statement->type != NODE_ASSIGN) continue;
+		statement->value.var.expr = NULL;
+		ast_free(statement);
+	}
+	list_free(statements);
+	pj_free(root);
+	return saved;
+}
+
+// Define every variable and function of the snapshot at path in the instance's global scope.
+// The definitions live in the mapped snapshot, which the instance keeps until it is freed
+bool pj_vm_restore(PjVM *vm, const char *path){
+	if(!vm->owns_global || vm->snapshot != NULL) return false;
+	PjProgram *snapshot = image_map(path, SNAPSHOT_MAGIC, 0);
+	if(snapshot == NULL) return false;
+
+	AST *root = snapshot->root;
+	Node *curr = root && root->type == NODE_BLOCK ? root->value.statements->head : NULL;
+	for(; curr != NULL; curr = curr->next){
+		AST *statement = curr->value;
+		if(statement->type == NODE_FUNCTION) env_define_func(vm->global, statement->value.fn.fname, statement);
+		else if(statement->type == NODE_ASSIGN){
+			AST *value = statement->value.var.expr;
+			//only values a variable can hold are restored, the scope owns them from now on
+			if(value == NULL || (value->type != NODE_INT && value->type != NODE_FLOAT && value->type != NODE_BOOL)) continue;
+			statement->value.var.expr = NULL;
+			env_assign_var(vm->global, statement->value.var.vname, value);
+		}
+	}
+
+	//restored functions keep their site numbers until a program is loaded, see snapshot_move_sites
+	vm->snapshot_site = 0;
+	if(vm->cache_count < snapshot->sites){
+		vm->caches = (InlineCache*)pj_realloc(MEM_RUNTIME, vm->caches, snapshot->sites * sizeof(InlineCache));
+		memset(vm->caches + vm->cache_count, 0, (snapshot->sites - vm->cache_count) * sizeof(InlineCache));
+		vm->cache_count = snapshot->sites;
+	}
+	vm->snapshot = snapshot;
+	return true;
+}
+
+// Add shift to every site under node
+static void shift_sites(AST *node, int shift){
+	if(node == NULL) return;
+	shift_sites(node->left, shift);
+	shift_sites(node->right, shift);
+	List *list = NULL;
+	if(is_builtin_operator(node)) list = node->value.arguments;
+	else switch(node->type){
+		case NODE_BLOCK:		list = node->value.statements; break;
+		case NODE_IF_ELSE:	shift_sites(node->value.condition, shift); break;
+		case NODE_RETURN:		shift_sites(node->value.return_expr, shift); break;
+		case NODE_FUNCTION:	shift_sites(node->value.fn.fbody, shift); break;
+		case NODE_VARIABLE:
+			if(node->value.var.site >= 0) node->value.var.site += shift;
+			break;
+		case NODE_ASSIGN:
+			if(node->value.var.site >= 0) node->value.var.site += shift;
+			shift_sites(node->value.var.expr, shift);
+			break;
+		case NODE_CALL:
+			if(node->value.call_expr.site >= 0) node->value.call_expr.site += shift;
+			list = node->value.call_expr.arguments;
+			break;
+		default: break;
+	}
+	if(list)
+		for(Node *curr = list->head; curr != NULL; curr = curr->next) shift_sites(curr->value, shift);
+}
+
+// Number the sites of the restored functions from first on. Programs number their sites from 0,
+// so the instance moves the snapshot's after those of every program it loads
+void snapshot_move_sites(PjVM *vm, int first){
+	if(vm->snapshot == NULL || first == vm->snapshot_site) return;
+	shift_sites(vm->snapshot->root, first - vm->snapshot_site);
+	vm->snapshot_site = first;
+}
@@ -0,0 +1,140 @@
+#include "../includes/stats.h"
+#ifdef PJ_STATS
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "../includes/ast.h"
+#include "../includes/scope.h"
+#include "../includes/memory.h"
+
+/*===================== Counters =====================*/
+
+//pool threads evaluate too, so every counter is a shared relaxed atomic
+static atomic_ulong nodes[NODE_TYPES];
+static atomic_ulong lookups[STATS_DEPTHS];
+static atomic_ulong cached_lookups;
+static atomic_ulong missed_lookups;
+static atomic_ulong other_calls;
+static atomic_int max_depth;
+static _Thread_local int call_depth = 0;
+
+//open addressed by name, a slot's name is set once and never changes
+typedef struct FunctionCount {
+	_Atomic(char*) name;
+	atomic_ulong calls;
+} FunctionCount;
+static FunctionCount functions[STATS_FUNCTIONS];
+
+static const char *node_names[NODE_TYPES] = {
+	[NODE_FLOAT] = "float", [NODE_INT] = "int", [NODE_BOOL] = "bool", [NODE_OBJECT] = "object",
+	[NODE_ADD] = "add", [NODE_SUB] = "sub", [NODE_MUL] = "mul", [NODE_DIV] = "div",
+	[NODE_POW] = "pow", [NODE_MODULUS] = "modulus", [NODE_GT] = "gt", [NODE_GTE] = "gte",
+	[NODE_LT] = "lt", [NODE_LTE] = "lte", [NODE_EQUALS] = "equals", [NODE_NOT_EQUALS] = "not-equals",
+	[NODE_OR] = "or", [NODE_AND] = "and", [NODE_UNARY_NOT] = "not", [NODE_IF_ELSE] = "if-else",
+	[NODE_UNARY_PLUS] = "plus", [NODE_UNARY_MINUS] = "minus", [NODE_FUNCTION_ADD] = "add()",
+	[NODE_FUNCTION_SUB] = "sub()", [NODE_FUNCTION_MUL] = "mul()", [NODE_FUNCTION_DIV] = "div()",
+	[NODE_FUNCTION_PMAP] = "pmap()", [NODE_FUNCTION_PREDUCE] = "preduce()", [NODE_FUNCTION_PRINT] = "print()",
+	[NODE_FUNCTION_FLUSH] = "flush()", [NODE_VARIABLE] = "variable", [NODE_ASSIGN] = "assign",
+	[NODE_FUNCTION] = "function", [NODE_FUNC_VARIABLE] = "function-variable", [NODE_CALL] = "call",
+	[NODE_RETURN] = "return", [NODE_BLOCK] = "block", [NODE_NATIVE] = "native", [NODE_SLICE] = "slice"
+};
+
+void stats_node(int type){
+	if(type >= 0 && type < NODE_TYPES) atomic_fetch_add_explicit(&nodes[type], 1, memory_order_relaxed);
+}
+
+// Count a lookup resolved depth scopes above the one it started in, a negative depth for names not found
+void stats_lookup(int depth, bool cached){
+	if(cached) atomic_fetch_add_explicit(&cached_lookups, 1, memory_order_relaxed);
+	if(depth < 0){
+		atomic_fetch_add_explicit(&missed_lookups, 1, memory_order_relaxed);
+		return;
+	}
+	atomic_fetch_add_explicit(&lookups[depth < STATS_DEPTHS ? depth : STATS_DEPTHS - 1], 1, memory_order_relaxed);
+}
+
+// Slot counting calls of name, names are copied since the program defining them may be freed before the report
+static FunctionCount* function_slot(const char *name){
+	unsigned int index = scope_hash((char*)name) & (STATS_FUNCTIONS - 1);
+	for(int probe = 0; probe < STATS_FUNCTIONS; probe++, index = (index + 1) & (STATS_FUNCTIONS - 1)){
+		FunctionCount *slot = &functions[index];
+		char *current = atomic_load_explicit(&slot->name, memory_order_acquire);
+		if(current == NULL){
+			char *copy = (char*)pj_malloc(MEM_OTHER, strlen(name) + 1);
+			strcpy(copy, name);
+			if(atomic_compare_exchange_strong(&slot->name, &current, copy)) return slot;
+			//another thread claimed the slot first, current now holds its name
+			pj_free(copy);
+		}
+		if(strcmp(current, name) == 0) return slot;
+	}
+	return NULL;
+}
+
+void stats_call_enter(const char *name){
+	FunctionCount *slot = function_slot(name);
+	atomic_fetch_add_explicit(slot ? &slot->calls : &other_calls, 1, memory_order_relaxed);
+	int depth = ++call_depth;
+	int max = atomic_load_explicit(&max_depth, memory_order_relaxed);
+	while(depth > max && !atomic_compare_exchange_weak_explicit(&max_depth, &max, depth, memory_order_relaxed, memory_order_relaxed));
+}
+
+void stats_call_leave(void){
+	call_depth--;
+}
+
+/*===================== Report =====================*/
+
+typedef struct Bucket {
+	const char *name;
+	unsigned long count;
+} Bucket;
+
+static int compare_buckets(const void *a, const void *b){
+	unsigned long x = ((const Bucket*)a)->count, y = ((const Bucket*)b)->count;
+	return x < y ? 1 : x > y ? -1 : strcmp(((const Bucket*)a)->name, ((const Bucket*)b)->name);
+}
+
+// Print buckets with a share and a bar scaled to the largest, sorted by count unless they have an order of their own
+static void print_histogram(FILE *out, const char *title, Bucket *buckets, int count, bool sort){
+	if(sort) qsort(buckets, count, sizeof(Bucket), compare_buckets);
+	unsigned long total = 0, largest = 0;
+	for(int i = 0; i < count; i++){
+		total += buckets[i].count;
+		if(buckets[i].count > largest) largest = buckets[i].count;
+	}
+	fprintf(out, "%s (%lu)\n", title, total);
+	for(int i = 0; i < count; i++){
+		if(buckets[i].count == 0) continue;
+		int width = (int)(buckets[i].count * 40 / largest);
+		fprintf(out, "  %-20s %14lu %6.2f%% ", buckets[i].name, buckets[i].count, buckets[i].count * 100.0 / total);
+		for(int j = 0; j < (width > 0 ? width : 1); j++) fputc('#', out);
+		fputc('\n', out);
+	}
+}
+
+void stats_report(FILE *out){
+	Bucket buckets[STATS_FUNCTIONS + 1];
+	for(int type = 0; type < NODE_TYPES; type++)
+		buckets[type] = (Bucket){ node_names[type] ? node_names[type] : "?", atomic_load(&nodes[type]) };
+	print_histogram(out, "nodes evaluated", buckets, NODE_TYPES, true);
+
+	char depths[STATS_DEPTHS][16];
+	for(int depth = 0; depth < STATS_DEPTHS; depth++){
+		snprintf(depths[depth], sizeof(depths[depth]), depth < STATS_DEPTHS - 1 ? "depth %d" : "depth %d+", depth);
+		buckets[depth] = (Bucket){ depths[depth], atomic_load(&lookups[depth]) };
+	}
+	buckets[STATS_DEPTHS] = (Bucket){ "not found", atomic_load(&missed_lookups) };
+	print_histogram(out, "lookups by scope depth", buckets, STATS_DEPTHS + 1, false);
+	fprintf(out, "  %-20s %14lu\n", "inline cache hits", atomic_load(&cached_lookups));
+
+	int count = 0;
+	for(int i = 0; i < STATS_FUNCTIONS; i++){
+		char *name = atomic_load(&functions[i].name);
+		if(name) buckets[count++] = (Bucket){ name, atomic_load(&functions[i].calls) };
+	}
+	buckets[count++] = (Bucket){ "<other functions>", atomic_load(&other_calls) };
+	print_histogram(out, "calls per function", buckets, count, true);
+	fprintf(out, "max recursion depth %d\n", atomic_load(&max_depth));
+}
+#endif
@@ -0,0 +1,77 @@
+#include <string.h>
+#include <ctype.h>
+#include "../includes/stream.h"
+#include "../includes/memory.h"
+
+/*===================== STREAM =====================*/
+
+void splitter_init(StatementSplitter *splitter){
+	splitter->buffer = NULL;
+	splitter->length = 0;
+	splitter->capacity = 0;
+	splitter->start = 0;
+	splitter->scanned = 0;
+	splitter->depth = 0;
+}
+
+// Append input, consumed statements are dropped first so the buffer only grows with the longest statement
+void splitter_feed(StatementSplitter *splitter, const char *data, size_t length){
+	if(splitter->start > 0){
+		splitter->length -= splitter->start;
+		splitter->scanned -= splitter->start;
+		memmove(splitter->buffer, splitter->buffer + splitter->start, splitter->length);
+		splitter->start = 0;
+	}
+	if(splitter->length + length > splitter->capacity){
+		size_t capacity = splitter->capacity ? splitter->capacity : 4096;
+		while(capacity < splitter->length + length) capacity *= 2;
+		splitter->buffer = (char*)pj_realloc(MEM_IO, splitter->buffer, capacity);
+		splitter->capacity = capacity;
+	}
+	memcpy(splitter->buffer + splitter->length, data, length);
+	splitter->length += length;
+}
+
+static bool is_blank(const char *text, size_t length){
+	for(size_t i = 0; i < length; i++)
+		if(!isspace((unsigned char)text[i])) return false;
+	return true;
+}
+
+// Next complete statement including its newline, false until more input arrives.
+// The statement stays valid until the next call to splitter_feed
+bool splitter_next(StatementSplitter *splitter, const char **statement, size_t *length){
+	while(splitter->scanned < splitter->length){
+		char c = splitter->buffer[splitter->scanned++];
+		if(c == '{' || c == '(') splitter->depth++;
+		else if((c == '}' || c == ')') && splitter->depth > 0) splitter->depth--;
+		else if(c == '\n' && splitter->depth == 0){
+			const char *text = splitter->buffer + splitter->start;
+			size_t size = splitter->scanned - splitter->start;
+			splitter->start = splitter->scanned;
+			if(is_blank(text, size)) continue;
+			*statement = text;
+			*length = size;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Whatever is left once the input ended, false when only blanks are left
+bool splitter_finish(StatementSplitter *splitter, const char **statement, size_t *length){
+	if(splitter_next(splitter, statement, length)) return true;
+	const char *text = splitter->buffer + splitter->start;
+	size_t size = splitter->length - splitter->start;
+	splitter->start = splitter->scanned = splitter->length;
+	splitter->depth = 0;
+	if(size == 0 || is_blank(text, size)) return false;
+	*statement = text;
+	*length = size;
+	return true;
+}
+
+void splitter_free(StatementSplitter *splitter){
+	pj_free(splitter->buffer);
+	splitter_init(splitter);
+}
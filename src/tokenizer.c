@@ -1,4 +1,6 @@
 #include "../includes/tokenizer.h"
+#include "../includes/memory.h"
+#include "../includes/debug.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,24 +11,25 @@
 
 // Initialize a token with given value and type
 Token* token_init(char *value, int type){
-	Token *token = (Token*)malloc(sizeof(Token)); 
+	Token *token = (Token*)pj_malloc(MEM_LEXER, sizeof(Token)); 
 	token->value = value; 
 	token->type = type; 
+	DEBUG_LOG(DEBUG_LEXER, DEBUG_VERBOSE, "token %d `%s`", type, value);
 	return token; 
 }
 
 // Convert token to string representation
 char* token_to_str(Token *token){
 	if(!token) return "";
-	char* token_str = (char*)calloc(BUFF_SIZE, sizeof(char)); 
+	char* token_str = (char*)pj_calloc(MEM_LEXER, BUFF_SIZE, sizeof(char)); 
 	sprintf(token_str, "token(%d, `%s`)", token->type, token->value);
 	return token_str;
 }
 
 void token_free(void *token){
 	Token *t = (Token*)token;
-	free(t->value);
-	free(t);
+	pj_free(t->value);
+	pj_free(t);
 }
 
 // Tokenize the input string and return a list of tokens
@@ -55,41 +58,41 @@ List* tokenize(char *input){
 			iter += strlen(op); //next character
 		}
 		else if(is_paren(*iter)){
-			char *paren = (char*)calloc(1, sizeof(char));
+			char *paren = (char*)pj_calloc(MEM_LEXER, 2, sizeof(char));
 			*paren = *iter;
 			list_push(tokens, (void*)token_init(paren, *paren == '(' ? TOKEN_LPAREN : TOKEN_RPAREN));
 			iter++; //next character
 		}
 		else if(is_comma(*iter)){
-			char *comma = (char*)calloc(1, sizeof(char)); // Allocate memory for comma token
+			char *comma = (char*)pj_calloc(MEM_LEXER, 2, sizeof(char)); // Allocate memory for comma token
 			*comma = *iter; // Set the comma value
 			list_push(tokens, (void*)token_init(comma, TOKEN_COMMA));
 			iter++; //next character
 		}
 		else if(*iter == ':'){
-			char *colon = (char*)calloc(1, sizeof(char)); // Allocate memory for comma token
+			char *colon = (char*)pj_calloc(MEM_LEXER, 2, sizeof(char)); // Allocate memory for comma token
 			*colon = *iter; // Set the colon value
 			list_push(tokens, (void*)token_init(colon, TOKEN_COLON));
 			iter++; //next character
 		}
 		else if(*iter == '[' || *iter == ']'){
-			char *bracket = (char*)calloc(1, sizeof(char)); // Allocate memory for comma token
+			char *bracket = (char*)pj_calloc(MEM_LEXER, 2, sizeof(char)); // Allocate memory for comma token
 			*bracket = *iter; // Set the bracket value
 			list_push(tokens, (void*)token_init(bracket, *iter == '[' ? TOKEN_RBRACKET : TOKEN_LBRACKET));
 			iter++; //next character
 		}
 		else if(*iter == '{' || *iter == '}'){
-			char *brace = (char*)calloc(1, sizeof(char)); // Allocate memory for comma token
+			char *brace = (char*)pj_calloc(MEM_LEXER, 2, sizeof(char)); // Allocate memory for comma token
 			*brace = *iter; // Set the colon value
 			list_push(tokens, (void*)token_init(brace, *iter == '{' ? TOKEN_LBRACE : TOKEN_RBRACE));
 			iter++; //next character
 		}
 		else if(*iter == '<'){
-			char *eq = (char*)calloc(1, sizeof(char)); // Allocate memory for comma token
+			char *eq = (char*)pj_calloc(MEM_LEXER, 2, sizeof(char)); // Allocate memory for comma token
 			*eq = *iter; // Set the comma value
 			int type = TOKEN_LT;
 			if(*(iter + 1) && *(iter + 1) == '='){
-				eq = realloc(eq, sizeof(char) * 3);
+				eq = pj_realloc(MEM_LEXER, eq, sizeof(char) * 3);
 				eq[0] = '<';
 				eq[1] = '=';
 				eq[2] = '\0';
@@ -100,11 +103,11 @@ List* tokenize(char *input){
 			iter++; //next character
 		}
 		else if(*iter == '>'){
-			char *eq = (char*)calloc(1, sizeof(char)); // Allocate memory for comma token
+			char *eq = (char*)pj_calloc(MEM_LEXER, 2, sizeof(char)); // Allocate memory for comma token
 			*eq = *iter; // Set the comma value
 			int type = TOKEN_GT;
 			if(*(iter + 1) && *(iter + 1) == '='){
-				eq = realloc(eq, sizeof(char) * 3);
+				eq = pj_realloc(MEM_LEXER, eq, sizeof(char) * 3);
 				eq[0] = '>';
 				eq[1] = '=';
 				eq[2] = '\0';
@@ -115,11 +118,11 @@ List* tokenize(char *input){
 			iter++; //next character
 		}
 		else if(*iter == '='){
-			char *eq = (char*)calloc(1, sizeof(char)); // Allocate memory for comma token
+			char *eq = (char*)pj_calloc(MEM_LEXER, 2, sizeof(char)); // Allocate memory for comma token
 			*eq = *iter; // Set the comma value
 			int type = TOKEN_EQ;
 			if(*(iter + 1) && (*(iter + 1) == '=' || *(iter + 1) == '>')){
-				eq = realloc(eq, sizeof(char) * 3);
+				eq = pj_realloc(MEM_LEXER, eq, sizeof(char) * 3);
 				eq[0] = *iter;
 				eq[1] = *(iter + 1);
 				eq[2] = '\0';
@@ -130,11 +133,11 @@ List* tokenize(char *input){
 			iter++; //next character
 		}
 		else if(*iter == '!'){
-			char *eq = (char*)calloc(1, sizeof(char)); // Allocate memory for comma token
+			char *eq = (char*)pj_calloc(MEM_LEXER, 2, sizeof(char)); // Allocate memory for comma token
 			*eq = *iter; // Set the comma value
 			int type = TOKEN_NOT;
 			if(*(iter + 1) && *(iter + 1) == '='){
-				eq = realloc(eq, sizeof(char) * 3);
+				eq = pj_realloc(MEM_LEXER, eq, sizeof(char) * 3);
 				eq[0] = '!';
 				eq[1] = '=';
 				eq[2] = '\0';
@@ -145,7 +148,7 @@ List* tokenize(char *input){
 			iter++; //next character
 		}
 		else if(*iter == '\n'){
-			char *newline = (char*)calloc(8, sizeof(char)); // Allocate memory for comma token
+			char *newline = (char*)pj_calloc(MEM_LEXER, 8, sizeof(char)); // Allocate memory for comma token
 			strcpy(newline, "NEWLINE");
 			newline[7] = '\0';
 			list_push(tokens, (void*)token_init(newline, TOKEN_NEWLINE));
@@ -157,12 +160,12 @@ List* tokenize(char *input){
 
 // Tokenize numeric value from the input iterator
 char *tokenize_numeric(char *iter, int *type){
-	char *num = (char*)calloc(1, sizeof(char));
+	char *num = (char*)pj_calloc(MEM_LEXER, 2, sizeof(char));
 	int index = 0;
 	*type = TOKEN_INT;
 	while(is_numeric(*iter) || *iter == '.'){
 		if(*iter == '.') *type = TOKEN_FLOAT;
-		num = (char*)realloc(num, 1 + index);
+		num = (char*)pj_realloc(MEM_LEXER, num, 2 + index);
 		num[index++] = *(iter++); 
 	}
 	num[index] = '\0'; 
@@ -170,10 +173,10 @@ char *tokenize_numeric(char *iter, int *type){
 }
 
 char *tokenize_op(char *iter, int *type){
-	char *op = (char*)calloc(1, sizeof(char));
+	char *op = (char*)pj_calloc(MEM_LEXER, 2, sizeof(char));
 	op[0] = *iter; 
 	if(*(iter + 1) && *op == '*' && *(iter + 1) == '*') {
-		op = realloc(op, 3);
+		op = pj_realloc(MEM_LEXER, op, 3);
 		op[0] = '*';
 		op[1] = '*';
 		op[2] = '\0';
@@ -190,11 +193,12 @@ char *tokenize_op(char *iter, int *type){
 
 // Tokenize identifier from the input iterator
 char *tokenize_keyword(char *iter){
-	char *id = (char*)calloc(1, sizeof(char)); 
+	char *id = (char*)pj_calloc(MEM_LEXER, 2, sizeof(char)); 
 	int index = 0;
 
-	while(is_alpha(*iter)){ 
-		id = (char*)realloc(id, 1 + index); 
+	//digits may follow the first letter
+	while(is_alpha(*iter) || (index > 0 && is_numeric(*iter))){ 
+		id = (char*)pj_realloc(MEM_LEXER, id, 2 + index); 
 		id[index++] = *(iter++); 
 	}
 	id[index] = '\0'; 
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "../includes/trace.h"
+#include "../includes/memory.h"
+
+bool trace_enabled = false;
+static _Thread_local TraceBuffer *local = NULL;
+
+//tracing runs once per process, buffers of every thread that recorded are written and freed by trace_finish
+static struct {
+	TraceBuffer *buffers;
+	int threads;
+	pthread_mutex_t lock;
+	unsigned long start;
+	const char *path;
+} tracer = { NULL, 0, PTHREAD_MUTEX_INITIALIZER, 0, NULL };
+
+static unsigned long now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long)ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+// Buffer of the calling thread, only registering a new thread takes the lock
+static TraceBuffer* trace_buffer(void){
+	if(local) return local;
+	TraceBuffer *buffer = (TraceBuffer*)pj_malloc(MEM_OTHER, sizeof(TraceBuffer));
+	buffer->events = (TraceEvent*)pj_malloc(MEM_OTHER, TRACE_EVENTS * sizeof(TraceEvent));
+	buffer->count = 0;
+	pthread_mutex_lock(&tracer.lock);
+	buffer->tid = tracer.threads++;
+	buffer->next = tracer.buffers;
+	tracer.buffers = buffer;
+	pthread_mutex_unlock(&tracer.lock);
+	local = buffer;
+	return buffer;
+}
+
+void trace_record(const char *name, int arg, char phase){
+	TraceBuffer *buffer = trace_buffer();
+	TraceEvent *event = &buffer->events[buffer->count++ & (TRACE_EVENTS - 1)];
+	event->name = name;
+	event->ns = now_ns() - tracer.start;
+	event->arg = arg;
+	event->phase = phase;
+}
+
+// Record spans until trace_finish writes them to path as Chrome trace event JSON
+void trace_start(const char *path){
+	tracer.path = path;
+	tracer.start = now_ns();
+	trace_enabled = true;
+	//the starting thread is registered first so it gets tid 0
+	trace_buffer();
+}
+
+static void write_event(FILE *out, bool *first, int tid, char phase, unsigned long ns, const char *name, int arg){
+	fprintf(out, "%s\n{\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%lu.%03lu", *first ? "" : ",", phase, tid, ns / 1000, ns % 1000);
+	if(name) fprintf(out, ",\"name\":\"%s\"", name);
+	if(arg >= 0) fprintf(out, ",\"args\":{\"statement\":%d}", arg);
+	fprintf(out, "}");
+	*first = false;
+}
+
+// Write every thread's events, spans cut by the ring buffer are dropped or closed so begins and ends match.
+// Called before the programs whose function names the events point into are freed
+void trace_finish(void){
+	if(!trace_enabled) return;
+	trace_enabled = false;
+	unsigned long end = now_ns() - tracer.start;
+
+	FILE *out = fopen(tracer.path, "w");
+	if(out == NULL) perror(tracer.path);
+	else {
+		bool first = true;
+		fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+		for(TraceBuffer *buffer = tracer.buffers; buffer != NULL; buffer = buffer->next){
+			fprintf(out, "%s\n{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"%s %d\"}}",
+				first ? "" : ",", buffer->tid, buffer->tid == 0 ? "main" : "worker", buffer->tid);
+			first = false;
+
+			unsigned long from = buffer->count > TRACE_EVENTS ? buffer->count - TRACE_EVENTS : 0;
+			int open = 0;
+			for(unsigned long i = from; i < buffer->count; i++){
+				TraceEvent *event = &buffer->events[i & (TRACE_EVENTS - 1)];
+				//ends of spans whose begin was overwritten
+				if(event->phase == 'E' && open == 0) continue;
+				open += event->phase == 'B' ? 1 : -1;
+				write_event(out, &first, buffer->tid, event->phase, event->ns, event->phase == 'B' ? event->name : NULL, event->arg);
+			}
+			//spans still running, for a trace finished from inside them
+			for(; open > 0; open--) write_event(out, &first, buffer->tid, 'E', end, NULL, -1);
+		}
+		fprintf(out, "\n]}\n");
+		fclose(out);
+	}
+
+	while(tracer.buffers){
+		TraceBuffer *buffer = tracer.buffers;
+		tracer.buffers = buffer->next;
+		pj_free(buffer->events);
+		pj_free(buffer);
+	}
+}
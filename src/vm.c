@@ -0,0 +1,394 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "../includes/vm.h"
+#include "../includes/analysis.h"
+#include "../includes/chunks.h"
+#include "../includes/snapshot.h"
+#include "../includes/memory.h"
+#include "../includes/trace.h"
+#include "../includes/perf.h"
+
+//program ids are the only process wide counter, evaluation state lives in the instances
+static atomic_ulong next_program_id = 1;
+
+static void vm_release_lists(PjVM *vm);
+static unsigned long now_ns(void);
+
+/*===================== VM =====================*/
+
+// Tokenize and parse source into a program, returns NULL and fills error on syntax errors
+PjProgram* pj_compile(const char *source, Error *error){
+	return pj_compile_stats(source, error, NULL);
+}
+
+// pj_compile, measuring tokenizing and parsing separately when stats is set, analysis counts as parsing
+PjProgram* pj_compile_stats(const char *source, Error *error, PjCompileStats *stats){
+	if(parse_parallel){
+		PjProgram *program = pj_compile_chunks(source, error, stats);
+		if(program != NULL || error->err != NULL) return program;
+	}
+	error->err = NULL;
+	error->message = NULL;
+	error->type = ERR_NONE;
+
+	unsigned long allocations = pj_allocations();
+	unsigned long start = stats ? now_ns() : 0;
+	trace_begin("tokenize", -1);
+	perf_phase_begin(PERF_LEX);
+	List *tokens = tokenize((char*)source);
+	perf_phase_end(PERF_LEX);
+	trace_end("tokenize");
+	if(stats){
+		unsigned long end = now_ns();
+		stats->lex.nanoseconds = end - start;
+		stats->lex.allocations = pj_allocations() - allocations;
+		allocations = pj_allocations();
+		start = end;
+	}
+
+	//the parser only needs the builtin names, runtime values live in each instance
+	Enviroment *symbols = create_global_env(SYMBOL_SIZE);
+	Parser *parser = parser_init(tokens);
+	trace_begin("parse_block", -1);
+	perf_phase_begin(PERF_PARSE);
+	AST *root = parse_block(parser, symbols, false, error);
+	trace_end("parse_block");
+	env_free(symbols);
+	if(error->err == NULL){
+		trace_begin("analyze_program", -1);
+		analyze_program(root);
+		trace_end("analyze_program");
+	}
+	perf_phase_end(PERF_PARSE);
+	if(stats){
+		stats->parse.nanoseconds = now_ns() - start;
+		stats->parse.allocations = pj_allocations() - allocations;
+	}
+
+	PjProgram *program = vm_program_new();
+	program->tokens = parser->tokens;
+	program->root = root;
+	program->sites = parser->sites;
+	program->functions = parser->functions;
+	pj_free(parser);
+
+	if(error->err != NULL){
+		pj_program_free(program);
+		return NULL;
+	}
+	return program;
+}
+
+// Empty program with a fresh id, filled by the compiler or the image loader
+PjProgram* vm_program_new(void){
+	PjProgram *program = (PjProgram*)pj_malloc(MEM_PARSER, sizeof(PjProgram));
+	program->tokens = NULL;
+	program->chunks = NULL;
+	program->image = NULL;
+	program->image_size = 0;
+	program->root = NULL;
+	program->sites = 0;
+	program->functions = 0;
+	program->id = atomic_fetch_add(&next_program_id, 1);
+	return program;
+}
+
+void pj_program_free(PjProgram *program){
+	if(!program) return;
+	ast_free(program->root);
+	if(program->tokens) free_list(program->tokens, token_free);
+	if(program->chunks){
+		for(Node *curr = program->chunks->head; curr != NULL; curr = curr->next) free_list(curr->value, token_free);
+		list_free(program->chunks);
+	}
+	if(program->image) munmap(program->image, program->image_size);
+	pj_free(program);
+}
+
+// Create an interpreter instance with its own global enviroment
+PjVM* pj_vm_new(void){
+	PjVM *vm = (PjVM*)pj_malloc(MEM_RUNTIME, sizeof(PjVM));
+	vm->caches = NULL;
+	vm->cache_count = 0;
+	vm->program = 0;
+	vm->clock = 0;
+	vm->lists = createList();
+	vm->owns_global = true;
+	vm->fork_join = false;
+	vm->grain = FORK_GRAIN;
+	vm->spare_scopes = NULL;
+	vm->spare_nodes = NULL;
+	vm->natives = NULL;
+	vm->snapshot = NULL;
+	vm->snapshot_site = 0;
+	output_init(&vm->out, STDOUT_FILENO);
+	vm->global = create_global_env(SYMBOL_SIZE);
+	vm->global->vm = vm;
+	vm->global->version = ++vm->clock;
+	return vm;
+}
+
+// Prepare the instance to run program, lists returned by the previous evaluation are released
+static void vm_load(PjVM *vm, const PjProgram *program){
+	vm_release_lists(vm);
+	//caches are indexed by site, so they only survive while the same program runs
+	if(vm->program != program->id){
+		int sites = program->sites;
+		//restored functions get the sites after the program's, so the two never share a cache
+		if(vm->snapshot){
+			if(vm->snapshot_site < sites) snapshot_move_sites(vm, sites);
+			sites = vm->snapshot_site + vm->snapshot->sites;
+		}
+		if(vm->cache_count < sites){
+			vm->caches = (InlineCache*)pj_realloc(MEM_RUNTIME, vm->caches, sites * sizeof(InlineCache));
+			vm->cache_count = sites;
+		}
+		if(vm->cache_count > 0) memset(vm->caches, 0, vm->cache_count * sizeof(InlineCache));
+		vm->program = program->id;
+	}
+}
+
+// Evaluate a program in the instance's global enviroment
+RuntimeVal pj_vm_eval(PjVM *vm, const PjProgram *program){
+	//traced programs run a statement at a time so every statement gets its own span
+	if(trace_enabled) return pj_vm_eval_each(vm, program, NULL, NULL);
+	vm_load(vm, program);
+	perf_phase_begin(PERF_EVAL);
+	RuntimeVal result = eval_expr(program->root, vm->global);
+	perf_phase_end(PERF_EVAL);
+	return result;
+}
+
+// Evaluate a program one top level statement at a time, emit receives every statement's result when set
+RuntimeVal pj_vm_eval_each(PjVM *vm, const PjProgram *program, PjEmitFn emit, void *ctx){
+	vm_load(vm, program);
+	AST *root = program->root;
+	RuntimeVal result; result.type = RESULT_NONE; result.retval = false;
+	perf_phase_begin(PERF_EVAL);
+	if(root == NULL || root->type != NODE_BLOCK){
+		trace_begin("statement", 0);
+		result = eval_expr(root, vm->global);
+		trace_end("statement");
+		perf_phase_end(PERF_EVAL);
+		if(emit) emit(result, ctx);
+		return result;
+	}
+	int index = 0;
+	for(Node *curr = root->value.statements->head; curr != NULL; curr = curr->next, index++){
+		trace_begin("statement", index);
+		result = eval_expr(curr->value, vm->global);
+		trace_end("statement");
+		if(emit) emit(result, ctx);
+		if(result.retval) break;
+	}
+	perf_phase_end(PERF_EVAL);
+	return result;
+}
+
+void pj_vm_free(PjVM *vm){
+	if(!vm) return;
+	vm_release_lists(vm);
+	list_free(vm->lists);
+	if(vm->owns_global) env_free(vm->global);
+	pj_program_free(vm->snapshot);
+	while(vm->spare_scopes){
+		Enviroment *scope = vm->spare_scopes;
+		vm->spare_scopes = scope->parent;
+		scope_free(scope->names);
+		pj_free(scope);
+	}
+	while(vm->natives){
+		AST *native = vm->natives;
+		vm->natives = native->left;
+		native->left = NULL;
+		ast_free(native);
+	}
+	while(vm->spare_nodes){
+		AST *node = vm->spare_nodes;
+		vm->spare_nodes = node->left;
+		pj_free(node);
+	}
+	output_free(&vm->out);
+	pj_free(vm->caches);
+	pj_free(vm);
+}
+
+// Inline cache of a reference site, NULL when the site has none
+InlineCache* vm_site_cache(PjVM *vm, int site){
+	if(vm == NULL || site < 0 || site >= vm->cache_count) return NULL;
+	return &vm->caches[site];
+}
+
+// Allocate a list value owned by the instance
+RuntimeList* vm_new_list(PjVM *vm, int size){
+	RuntimeList *list = (RuntimeList*)pj_malloc(MEM_RUNTIME, sizeof(RuntimeList));
+	list->items = (RuntimeVal*)pj_malloc(MEM_RUNTIME, (size > 0 ? size : 1) * sizeof(RuntimeVal));
+	list->size = size;
+	list_push(vm->lists, list);
+	return list;
+}
+
+static void vm_release_lists(PjVM *vm){
+	if(vm->lists->size == 0) return;
+	Node *curr = vm->lists->head;
+	for(; curr != NULL; curr = curr->next){
+		RuntimeList *list = curr->value;
+		pj_free(list->items);
+		pj_free(list);
+	}
+	list_free(vm->lists);
+	vm->lists = createList();
+}
+
+// Create an instance for a task running on another thread. It reads the parent's scopes,
+// which stay unchanged while the task runs, and keeps its own caches, scopes and clock
+PjVM* vm_fork(PjVM *parent){
+	PjVM *child = (PjVM*)pj_malloc(MEM_RUNTIME, sizeof(PjVM));
+	child->global = parent->global;
+	child->owns_global = false;
+	child->program = parent->program;
+	child->cache_count = parent->cache_count;
+	child->caches = (InlineCache*)pj_calloc(MEM_RUNTIME, child->cache_count > 0 ? child->cache_count : 1, sizeof(InlineCache));
+	child->clock = parent->clock;
+	child->fork_join = parent->fork_join;
+	child->grain = parent->grain;
+	child->spare_scopes = NULL;
+	child->spare_nodes = NULL;
+	child->natives = NULL;
+	child->snapshot = NULL;
+	child->snapshot_site = 0;
+	output_init(&child->out, -1);
+	child->lists = createList();
+	return child;
+}
+
+// Hand the lists and output produced by a finished task to its parent and free the task's instance
+void vm_join(PjVM *parent, PjVM *child){
+	if(child->out.length > 0) output_write(&parent->out, child->out.data, child->out.length);
+	Node *curr = child->lists->head;
+	for(; curr != NULL; curr = curr->next) list_push(parent->lists, curr->value);
+	list_free(child->lists);
+	child->lists = createList();
+	pj_vm_free(child);
+}
+// Value node holding a number or slice, reusing a node the instance released earlier. NULL for other values
+AST* vm_value_node(PjVM *vm, RuntimeVal value){
+	if(value.type != RESULT_INT && value.type != RESULT_FLOAT && value.type != RESULT_SLICE) return NULL;
+	AST *node = vm ? vm->spare_nodes : NULL;
+	if(node){
+		vm->spare_nodes = node->left;
+		node->left = NULL;
+	}
+	else {
+		node = ast_init(NODE_INT, NULL, NULL);
+		//nodes holding values are made by evaluation, not by the parser
+		pj_retag(node, MEM_RUNTIME);
+	}
+
+	node->type = value.type == RESULT_INT ? NODE_INT : value.type == RESULT_FLOAT ? NODE_FLOAT : NODE_SLICE;
+	if(value.type == RESULT_INT) node->value.i_value = value.value.i_value;
+	else if(value.type == RESULT_FLOAT) node->value.f_value = value.value.f_value;
+	else node->value.slice = value.value.slice;
+	return node;
+}
+
+// Give back a variable's value node, literals are kept by the instance for reuse
+void vm_release_node(PjVM *vm, AST *node){
+	if(!node) return;
+	if(!vm || (node->type != NODE_INT && node->type != NODE_FLOAT && node->type != NODE_BOOL && node->type != NODE_SLICE)){
+		ast_free(node);
+		return;
+	}
+	node->left = vm->spare_nodes;
+	vm->spare_nodes = node;
+}
+
+/*===================== Embedding =====================*/
+
+// Make a C function callable by scripts evaluated in the instance. Natives called from
+// pmap, preduce or fork join tasks run on pool threads and must be thread safe
+bool pj_vm_register(PjVM *vm, const char *name, PjNativeFn fn, int arity, const PjArgType *types, void *data){
+	if(!vm || !vm->owns_global || !name || !fn || arity < 0) return false;
+	AST *native = make_native_node(name, fn, arity, types, data);
+	native->left = vm->natives;
+	vm->natives = native;
+	env_define_func(vm->global, native->value.native.name, native);
+	return true;
+}
+
+// Find a function defined at the top level of a program
+PjFunction pj_program_function(const PjProgram *program, const char *name){
+	PjFunction function = { program, NULL };
+	if(!program || !program->root || program->root->type != NODE_BLOCK) return function;
+	Node *curr = program->root->value.statements->head;
+	for(; curr != NULL; curr = curr->next){
+		AST *statement = curr->value;
+		//a later definition replaces an earlier one, as it does when the program runs
+		if(statement && statement->type == NODE_FUNCTION && strcmp(statement->value.fn.fname, name) == 0)
+			function.node = statement;
+	}
+	return function;
+}
+
+static unsigned long now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long)ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+// Call a function of the program last evaluated by the instance. Scopes and value nodes are
+// recycled by the instance, so once it is warmed up a call does not allocate
+RuntimeVal pj_call(PjVM *vm, PjFunction function, PjArgs *args, PjCallStats *stats){
+	unsigned long allocations = pj_allocations();
+	unsigned long start = stats ? now_ns() : 0;
+
+	RuntimeVal result;
+	if(function.node == NULL) result = make_error(RESULT_ERROR_UNDEFINED, "function is not defined by the program");
+	//sites of the function body index the caches of the loaded program
+	else if(vm->program != function.program->id) result = make_error(RESULT_ERROR_VALUE, "program is not loaded in this instance");
+	else {
+		vm_release_lists(vm);
+		result = apply_function(vm, function.node, vm->global, args->values, args->count);
+	}
+
+	if(stats){
+		stats->nanoseconds = now_ns() - start;
+		stats->allocations = pj_allocations() - allocations;
+	}
+	return result;
+}
+
+PjArgs* pj_args_new(int capacity){
+	PjArgs *args = (PjArgs*)pj_malloc(MEM_RUNTIME, sizeof(PjArgs));
+	args->values = (RuntimeVal*)pj_calloc(MEM_RUNTIME, capacity > 0 ? capacity : 1, sizeof(RuntimeVal));
+	args->count = 0;
+	args->capacity = capacity;
+	return args;
+}
+
+// Set argument index, the call passes every argument up to the highest one set
+void pj_args_int(PjArgs *args, int index, int64_t value){
+	if(index < 0 || index >= args->capacity) return;
+	args->values[index].type = RESULT_INT;
+	args->values[index].value.i_value = value;
+	args->values[index].retval = false;
+	if(index >= args->count) args->count = index + 1;
+}
+
+void pj_args_double(PjArgs *args, int index, double value){
+	if(index < 0 || index >= args->capacity) return;
+	args->values[index].type = RESULT_FLOAT;
+	args->values[index].value.f_value = value;
+	args->values[index].retval = false;
+	if(index >= args->count) args->count = index + 1;
+}
+
+void pj_args_free(PjArgs *args){
+	if(!args) return;
+	pj_free(args->values);
+	pj_free(args);
+}
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "../includes/vm.h"
+#include "../includes/memory.h"
+
+// Embedding test run by make test, script functions and natives are called through the C API the
+// way a host program calls them. Prints a line per failed check and exits with 1 when any failed
+
+//calls made after the warm up, none of them may allocate
+#define WARM_CALLS 1000
+
+static const char *source =
+	"fn poly: x => {\n"
+	"	return x * x + 3 * x + 1\n"
+	"}\n"
+	"fn mean: a, b => {\n"
+	"	return (a + b) / 2\n"
+	"}\n"
+	"fn scale_twice: x => {\n"
+	"	return scale(scale(x))\n"
+	"}\n"
+	"fn scale_pair: x => {\n"
+	"	return scale(x, x)\n"
+	"}\n"
+	"fn scale_flag: x => {\n"
+	"	return scale(true)\n"
+	"}\n";
+
+static int failures = 0;
+
+static void check(bool passed, const char *what){
+	if(passed) return;
+	printf("FAIL tests/embed.c: %s\n", what);
+	failures++;
+}
+
+// Native registered as scale, multiplies its int argument by the factor data points to
+static RuntimeVal scale(RuntimeVal *args, int argc, void *data){
+	RuntimeVal result = args[0];
+	result.value.i_value *= *(int64_t*)data;
+	return result;
+}
+
+// Call poly on the ints up to WARM_CALLS, the first calls fill the instance's caches and spares
+static void test_warm_calls(PjVM *vm, const PjProgram *program){
+	PjFunction poly = pj_program_function(program, "poly");
+	check(poly.node != NULL, "poly is defined");
+	PjArgs *args = pj_args_new(1);
+	PjCallStats stats;
+	for(int64_t x = 0; x < 2; x++){
+		pj_args_int(args, 0, x);
+		pj_call(vm, poly, args, NULL);
+	}
+	bool results = true;
+	unsigned long allocations = 0;
+	for(int64_t x = 0; x < WARM_CALLS; x++){
+		pj_args_int(args, 0, x);
+		RuntimeVal result = pj_call(vm, poly, args, &stats);
+		if(result.type != RESULT_INT || result.value.i_value != x * x + 3 * x + 1) results = false;
+		allocations += stats.allocations;
+	}
+	check(results, "poly(x) returns x * x + 3 * x + 1");
+	check(allocations == 0, "warm calls of poly do not allocate");
+	pj_args_free(args);
+}
+
+static void test_float_calls(PjVM *vm, const PjProgram *program){
+	PjFunction mean = pj_program_function(program, "mean");
+	PjArgs *args = pj_args_new(2);
+	pj_args_double(args, 0, 1.5);
+	pj_args_int(args, 1, 4);
+	RuntimeVal result = pj_call(vm, mean, args, NULL);
+	check(result.type == RESULT_FLOAT && result.value.f_value == 2.75, "mean(1.5, 4) returns 2.75");
+	pj_args_free(args);
+}
+
+static void test_undefined(PjVM *vm, const PjProgram *program){
+	PjFunction missing = pj_program_function(program, "missing");
+	PjArgs *args = pj_args_new(1);
+	pj_args_int(args, 0, 1);
+	RuntimeVal result = pj_call(vm, missing, args, NULL);
+	check(is_error(result) && strcmp(result.value.msg, "function is not defined by the program") == 0,
+		"calling an undefined function is an error");
+	pj_args_free(args);
+}
+
+// Call a function that calls scale, with x as its only argument
+static RuntimeVal call_scaling(PjVM *vm, const PjProgram *program, const char *name, int64_t x){
+	PjArgs *args = pj_args_new(1);
+	pj_args_int(args, 0, x);
+	RuntimeVal result = pj_call(vm, pj_program_function(program, name), args, NULL);
+	pj_args_free(args);
+	return result;
+}
+
+static void test_natives(PjVM *vm, const PjProgram *program){
+	RuntimeVal result = call_scaling(vm, program, "scale_twice", 5);
+	check(result.type == RESULT_INT && result.value.i_value == 45, "scale_twice(5) returns 45");
+	result = call_scaling(vm, program, "scale_pair", 5);
+	check(is_error(result) && strcmp(result.value.msg, "Too many arguments provided") == 0,
+		"a native given too many arguments is an error");
+	result = call_scaling(vm, program, "scale_flag", 5);
+	check(is_error(result) && strcmp(result.value.msg, "expected an int argument") == 0,
+		"a native given a boolean for an int is an error");
+}
+
+int main(void){
+	Error error;
+	PjProgram *program = pj_compile(source, &error);
+	if(program == NULL){
+		printf("FAIL tests/embed.c: %s %s\n", error.err, error.message);
+		return 1;
+	}
+	PjVM *vm = pj_vm_new();
+	int64_t factor = 3;
+	PjArgType types[] = { PJ_ARG_INT };
+	check(pj_vm_register(vm, "scale", scale, 1, types, &factor), "scale is registered");
+	pj_vm_eval(vm, program);
+
+	test_warm_calls(vm, program);
+	test_float_calls(vm, program);
+	test_undefined(vm, program);
+	test_natives(vm, program);
+
+	pj_vm_free(vm);
+	pj_program_free(program);
+	return failures > 0;
+}